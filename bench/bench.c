@@ -0,0 +1,422 @@
+// Copyright 2025 JesusTouchMe
+
+// viperos-bench. generates a few kinds of files and times loading, saving, editing at random places and
+// drawing screenfuls of them, then prints the numbers as json so they can be compared run to run.
+// rendering goes to the null terminal backend, so what's timed is the diffing and the escape sequences
+// it produces and not how fast some terminal emulator is. before any of that the vector kernels the
+// numbers depend on are checked against plain loops, a wrong answer there fails the whole run.
+//
+//   viperos-bench [--quick] [--out results.json]
+
+#include "filebuf.h"
+#include "scan.h"
+#include "terminal.h"
+#include "tui.h"
+#include "utf8.h"
+
+#include <sys/stat.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REPEAT 3 // load and save take the best of this many
+#define EDIT_BUDGET_NS 2000000000 // editing stops early after this long, long lines make every op slow
+
+#define CHECK_ROUNDS 100000
+#define CHECK_MAX_SIZE 300 // bytes, covers every block size and tail the kernels have
+
+#define SCREEN_WIDTH 160
+#define SCREEN_HEIGHT 48
+#define GUTTER 5
+
+struct workload {
+    const char* name;
+    int lines;
+    int min_len;
+    int max_len;
+    int long_every; // every nth line is long_len bytes instead, 0 for never
+    int long_len;
+    bool unicode; // tabs and multi-byte chars mixed in with the ascii
+};
+
+static const struct workload g_workloads[] = {
+    { "short_lines", 400000, 0, 80, 0, 0, false },
+    { "long_lines", 32, 0, 0, 1, 1 << 20, false },
+    { "mixed", 100000, 0, 120, 500, 64 << 10, true },
+};
+
+#define WORKLOAD_COUNT ((int) (sizeof(g_workloads) / sizeof(g_workloads[0])))
+
+struct settings {
+    int scale; // line counts and op counts are divided by this
+    int edit_ops;
+    int render_frames;
+};
+
+#define RNG_SEED 0x9E3779B97F4A7C15ull
+
+static uint64_t g_rng;
+
+static uint32_t rng(void) { // xorshift64, reseeded before anything random so every run does the same
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return (uint32_t) (g_rng >> 32);
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void write_text_line(FILE* f, int len, bool unicode) {
+    static const char* wide[] = { "\xC3\xA9", "\xE4\xB8\xAD", "\xF0\x9F\x98\x80", "\t" }; // é, 中, 😀 and a tab
+
+    for (int i = 0; i < len; i++) {
+        uint32_t r = rng();
+        if (unicode && r % 16 == 0) {
+            fputs(wide[(r >> 8) % 4], f);
+        } else if (r % 7 == 0) {
+            fputc(' ', f);
+        } else {
+            fputc('a' + (r >> 8) % 26, f);
+        }
+    }
+    fputc('\n', f);
+}
+
+static int generate(const struct workload* w, const struct settings* s, const char* path, size_t* out_size) {
+    FILE* f = fopen(path, "w");
+    if (f == NULL) return -1;
+
+    g_rng = RNG_SEED;
+    int lines = w->lines / s->scale > 0 ? w->lines / s->scale : 1;
+    for (int i = 0; i < lines; i++) {
+        int len = w->min_len + (w->max_len > w->min_len ? (int) (rng() % (w->max_len - w->min_len + 1)) : 0);
+        if (w->long_every > 0 && i % w->long_every == 0) len = w->long_len;
+        write_text_line(f, len, w->unicode);
+    }
+
+    if (fclose(f) != 0) return -1;
+
+    struct stat st;
+    if (stat(path, &st) != 0) return -1;
+    *out_size = st.st_size;
+    return 0;
+}
+
+static double mb_per_s(size_t bytes, int64_t ns) {
+    return ns > 0 ? (double) bytes / (1 << 20) / ((double) ns / 1e9) : 0;
+}
+
+// scan_mismatch and scan_mismatch_last on random buffers that differ in a few random places, against
+// plain loops. the sizes and offsets are random too, so unaligned starts and every tail length come up
+static int check_mismatch(void) {
+    static char a[CHECK_MAX_SIZE + 32];
+    static char b[CHECK_MAX_SIZE + 32];
+
+    g_rng = RNG_SEED;
+    for (int round = 0; round < CHECK_ROUNDS; round++) {
+        size_t size = rng() % (CHECK_MAX_SIZE + 1);
+        size_t offset = rng() % 32;
+        char* x = a + offset;
+        char* y = b + offset;
+
+        for (size_t i = 0; i < size; i++) x[i] = y[i] = rng() % 3; // few values, long equal runs
+        int changes = rng() % 4;
+        for (int i = 0; i < changes && size > 0; i++) y[rng() % size] ^= 1 + rng() % 2;
+
+        size_t first = 0;
+        while (first < size && x[first] == y[first]) first++;
+        size_t last = size;
+        while (last > 0 && x[last - 1] == y[last - 1]) last--;
+
+        size_t got_first = scan_mismatch(x, y, size);
+        size_t got_last = scan_mismatch_last(x, y, size);
+        if (got_first != first || got_last != last) {
+            fprintf(stderr, "viperos-bench: scan_mismatch is broken: size %zu offset %zu, first %zu (want %zu), "
+                            "last %zu (want %zu)\n", size, offset, got_first, first, got_last, last);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int64_t bench_load(const char* path) {
+    int64_t best = INT64_MAX;
+    for (int i = 0; i < REPEAT; i++) {
+        struct file_buffer fb;
+        int64_t start = now_ns();
+        if (open_file_buffer(&fb, path) != 0) return -1;
+        int64_t took = now_ns() - start;
+        close_file_buffer(&fb);
+
+        if (took < best) best = took;
+    }
+    return best;
+}
+
+static int64_t bench_save(const char* path) {
+    struct file_buffer fb;
+    if (open_file_buffer(&fb, path) != 0) return -1;
+
+    int64_t best = INT64_MAX;
+    for (int i = 0; i < REPEAT; i++) {
+        int64_t start = now_ns();
+        if (save_file_buffer(&fb) != 0) {
+            close_file_buffer(&fb);
+            return -1;
+        }
+        int64_t took = now_ns() - start;
+        if (took < best) best = took;
+    }
+
+    close_file_buffer(&fb);
+    return best;
+}
+
+// one op is moving to a random spot, typing 4 chars there and deleting 2 after them. *ops is how many
+// to do going in and how many there was time for coming out
+static int64_t bench_edit(const char* path, int* ops, struct fb_memory* memory) {
+    struct file_buffer fb;
+    if (open_file_buffer(&fb, path) != 0) return -1;
+
+    g_rng = RNG_SEED;
+    int64_t start = now_ns();
+    int done = 0;
+    for (; done < *ops; done++) {
+        if (done % 256 == 0 && now_ns() - start > EDIT_BUDGET_NS) break;
+
+        int line = rng() % fb.line_count;
+        int len = fb_line_length(&fb, line);
+        int col = len > 0 ? (int) (rng() % (len + 1)) : 0;
+
+        fb_set_cursor_pos(&fb, line, col);
+        for (int k = 0; k < 4; k++) fb_insert_char(&fb, line, 'a' + k);
+        fb_delete_chars(&fb, line, 2);
+    }
+    int64_t took = now_ns() - start;
+    *ops = done;
+
+    *memory = fb_memory(&fb);
+    close_file_buffer(&fb);
+    return took;
+}
+
+struct scratch {
+    char* data;
+    int cap;
+};
+
+static int scratch_fit(struct scratch* s, int len) {
+    if (len <= s->cap) return 0;
+
+    char* tmp = realloc(s->data, len);
+    if (tmp == NULL) return -1;
+    s->data = tmp;
+    s->cap = len;
+    return 0;
+}
+
+// about what the editor draws: a line number gutter and the soft wrapped rows of the lines from scroll on
+static void draw(struct file_buffer* fb, int scroll, struct scratch* text) {
+    struct dimensions size = tui_get_screen_size();
+    int wrap = size.width - GUTTER;
+
+    tui_clear();
+
+    int row_in_line;
+    int line = fb_line_at_row(fb, scroll, &row_in_line);
+    int loaded = -1;
+    int len = 0;
+    int rows = 0;
+
+    for (int y = 0; y < size.height - 1 && line < fb->line_count; y++) {
+        if (line != loaded) {
+            len = fb_line_length(fb, line);
+            if (scratch_fit(text, len) != 0) return;
+            fb_read_line(fb, line, text->data);
+            rows = fb_line_rows(fb, line);
+            loaded = line;
+        }
+
+        if (row_in_line == 0) {
+            char num[16];
+            int n = snprintf(num, sizeof(num), "%4d", line + 1);
+            for (int i = 0; i < n && i < GUTTER - 1; i++) tui_put_styled(i, y, num[i], TUI_FG(TUI_ANSI(8)));
+        }
+
+        int first = row_in_line * wrap;
+        int col = fb_vcol_to_col(fb, line, first);
+        int end = fb_vcol_to_col(fb, line, first + wrap);
+        while (col < end) {
+            uint32_t cp;
+            int n = utf8_decode(text->data + col, len - col, &cp);
+            int x = fb_col_to_vcol(fb, line, col) - first;
+            if (x >= 0 && cp != '\t') tui_put_styled(GUTTER + x, y, cp, 0);
+            col += n;
+        }
+
+        if (++row_in_line >= rows) {
+            line++;
+            row_in_line = 0;
+        }
+    }
+
+    char status[64];
+    int n = snprintf(status, sizeof(status), "NORMAL  row %d", scroll);
+    for (int i = 0; i < n; i++) tui_put_styled(i, size.height - 1, status[i], TUI_INVERT);
+
+    tui_render();
+}
+
+struct render_result {
+    int64_t ns;
+    int frames;
+    size_t bytes;
+};
+
+// frames worth of scrolling down step rows at a time, back to the top at the end of the file
+static int bench_render(const char* path, int frames, int step, struct render_result* result) {
+    struct file_buffer fb;
+    if (open_file_buffer(&fb, path) != 0) return -1;
+
+    struct scratch text = { NULL, 0 };
+    struct dimensions size = tui_get_screen_size();
+    fb_set_wrap_width(&fb, size.width - GUTTER);
+
+    int total = fb_total_rows(&fb);
+    int scroll = 0;
+
+    draw(&fb, scroll, &text); // the first frame draws everything, that's not what's being measured
+    size_t bytes = term_bytes_written();
+
+    int64_t start = now_ns();
+    for (int i = 0; i < frames; i++) {
+        scroll += step;
+        if (scroll > total - (size.height - 1)) scroll = 0;
+        draw(&fb, scroll, &text);
+    }
+
+    result->ns = now_ns() - start;
+    result->frames = frames;
+    result->bytes = term_bytes_written() - bytes;
+
+    free(text.data);
+    close_file_buffer(&fb);
+    return 0;
+}
+
+static void print_render(FILE* out, const char* name, const struct render_result* r, bool last) {
+    fprintf(out, "      \"%s\": { \"frames\": %d, \"us_per_frame\": %.2f, \"bytes_per_frame\": %.1f }%s\n",
+            name, r->frames, r->frames > 0 ? (double) r->ns / 1e3 / r->frames : 0,
+            r->frames > 0 ? (double) r->bytes / r->frames : 0, last ? "" : ",");
+}
+
+static int run_workload(FILE* out, const struct workload* w, const struct settings* s, const char* dir, bool last) {
+    char path[4096];
+    if (snprintf(path, sizeof(path), "%s/%s.txt", dir, w->name) >= (int) sizeof(path)) return -1;
+
+    size_t size;
+    if (generate(w, s, path, &size) != 0) {
+        fprintf(stderr, "viperos-bench: couldn't write %s\n", path);
+        return -1;
+    }
+    fprintf(stderr, "%s: %zu bytes\n", w->name, size);
+
+    struct file_buffer fb;
+    if (open_file_buffer(&fb, path) != 0) return -1;
+    int lines = fb.line_count;
+    close_file_buffer(&fb);
+
+    int64_t load = bench_load(path);
+    int64_t save = bench_save(path);
+
+    struct fb_memory memory;
+    int edits = s->edit_ops;
+    int64_t edit = bench_edit(path, &edits, &memory);
+
+    struct render_result page;
+    struct render_result scroll;
+    if (load < 0 || save < 0 || edit < 0
+            || bench_render(path, s->render_frames, SCREEN_HEIGHT - 1, &page) != 0
+            || bench_render(path, s->render_frames, 1, &scroll) != 0) {
+        fprintf(stderr, "viperos-bench: %s failed\n", w->name);
+        unlink(path);
+        return -1;
+    }
+
+    unlink(path);
+
+    fprintf(out, "    {\n");
+    fprintf(out, "      \"name\": \"%s\",\n", w->name);
+    fprintf(out, "      \"bytes\": %zu,\n", size);
+    fprintf(out, "      \"lines\": %d,\n", lines);
+    fprintf(out, "      \"load\": { \"ms\": %.3f, \"mb_per_s\": %.1f },\n", load / 1e6, mb_per_s(size, load));
+    fprintf(out, "      \"save\": { \"ms\": %.3f, \"mb_per_s\": %.1f },\n", save / 1e6, mb_per_s(size, save));
+    fprintf(out, "      \"edit\": { \"ops\": %d, \"ns_per_op\": %.1f, \"live_bytes\": %zu, \"slack_bytes\": %zu },\n",
+            edits, edits > 0 ? (double) edit / edits : 0, memory.live, memory.slack);
+    print_render(out, "render_page", &page, false);
+    print_render(out, "render_scroll", &scroll, true);
+    fprintf(out, "    }%s\n", last ? "" : ",");
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    struct settings s = { .scale = 1, .edit_ops = 200000, .render_frames = 2000 };
+    const char* out_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            s = (struct settings) { .scale = 10, .edit_ops = 20000, .render_frames = 200 };
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--quick] [--out results.json]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (check_mismatch() != 0) return 1;
+
+    const char* tmp = getenv("TMPDIR");
+    char dir[4096];
+    snprintf(dir, sizeof(dir), "%s/viperos-bench.XXXXXX", tmp != NULL ? tmp : "/tmp");
+    if (mkdtemp(dir) == NULL) {
+        perror("viperos-bench: mkdtemp");
+        return 1;
+    }
+
+    FILE* out = out_path != NULL ? fopen(out_path, "w") : stdout;
+    if (out == NULL) {
+        perror("viperos-bench");
+        rmdir(dir);
+        return 1;
+    }
+
+    term_use(&term_null, (struct dimensions) { SCREEN_WIDTH, SCREEN_HEIGHT });
+    term_init();
+    tui_init();
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"quick\": %s,\n", s.scale > 1 ? "true" : "false");
+    fprintf(out, "  \"screen\": { \"width\": %d, \"height\": %d },\n", SCREEN_WIDTH, SCREEN_HEIGHT);
+    fprintf(out, "  \"workloads\": [\n");
+
+    int status = 0;
+    for (int i = 0; i < WORKLOAD_COUNT && status == 0; i++) {
+        status = run_workload(out, &g_workloads[i], &s, dir, i == WORKLOAD_COUNT - 1);
+    }
+
+    fprintf(out, "  ]\n}\n");
+
+    tui_destroy();
+    if (out != stdout) fclose(out);
+    rmdir(dir);
+    return status == 0 ? 0 : 1;
+}
@@ -3,24 +3,122 @@
 #ifndef FILEBUF_H
 #define FILEBUF_H 1
 
+#include "linepool.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+enum line_storage {
+    LINE_HEAP, // own gap buffer from file_buffer.pool
+    LINE_SLAB, // slot in file_buffer.slab, edited in place until it outgrows the slot
+    LINE_VIEW, // points straight into file_buffer.text with an empty gap, read only
+};
+
 struct line_buffer {
     char* buf;
     int len;
     int gap_start;
     int gap_end;
+    enum line_storage storage;
+};
+
+// a line buffer that was freed while a snapshot still had it, see fb_snapshot_take
+struct retired_buf {
+    char* buf;
+    int size;
+};
+
+struct line_node;
+struct paged_file;
+struct undo_journal;
+
+#define LINE_TREE_DEPTH 16
+
+// what changed since fb_take_damage was last called. every line from `from` on may be different, except the
+// last `tail` lines, which are the same as the last `tail` lines were back then, only moved if lines came or went
+struct fb_damage {
+    int from; // line_count if nothing changed
+    int tail;
+    int old_count; // line_count back then
+};
+
+// the path down to the leaf of the last line lookup. most lookups hit the same leaf again
+struct line_finger {
+    struct line_node* node[LINE_TREE_DEPTH];
+    int pos[LINE_TREE_DEPTH];
+    int depth; // 0 when there's nothing cached
+    int start; // first line in the leaf
+};
+
+#define COL_CACHE_MAX 64
+
+#define FB_HOT_LINES 16
+
+// where the chars of a recently used line start and which screen column each one lands in, see utf8.h
+struct col_cache_entry {
+    int line; // -1 if the slot is free
+    int wrap; // the layout depends on the wrap width
+    int count; // chars in the line, -1 if it's plain ascii and bytes are columns
+    int width;
+    int* starts; // count + 1 of each
+    int* vcols;
+    int cap;
 };
 
 struct file_buffer {
     int fd;
+    char* path; // resolved, saves replace whatever is at this path
 
-    struct line_buffer* lines;
+    // big files stay as they were loaded and their lines are views into the text. a line only gets
+    // its own gap buffer once something is inserted into it
+    char* text;
+    size_t text_size;
+    bool text_mapped; // mmap'd instead of read into the heap
+
+    // small files get every line packed into this instead, each with a bit of slack to type into
+    char* slab;
+
+    struct line_node* root; // see linetree.h
     int line_count;
+    struct line_finger finger;
+
+    // the tree also sums up how many screen rows lines wrap into at wrap_width chars.
+    // changing the width only marks those stale, they're recounted the next time rows are needed
+    int wrap_width;
+    bool rows_stale;
+
+    struct undo_journal* undo; // every change gets recorded in here if it's set
+    unsigned long changes; // goes up with every change, to tell whether anything happened since
+    struct fb_damage damage; // where, see fb_take_damage
+
+    struct col_cache_entry col_cache[COL_CACHE_MAX]; // by line number, dropped whenever its line changes
+
+    // line memory, see fb_memory. held is live plus slack, it's all kept up to date edit by edit
+    struct line_pool pool;
+    size_t live_bytes;
+    size_t held_bytes;
+
+    // idle compaction, see fb_compact
+    int hot[FB_HOT_LINES]; // the lines edited last, left alone since they're likely to be edited again
+    int hot_next;
+    int compact_at; // where the pass going on is, -1 if there's none
+    size_t compact_waste; // slack and pooled bytes when the last one ended
+
+    // while a snapshot is out, see fb_snapshot_take
+    bool shared;
+    struct retired_buf* retired;
+    int retired_count;
+    int retired_cap;
+
+    // files too big for any of the above are read a page at a time instead, see paged.h. there's no
+    // text, slab or line tree then, and lines can only be edited in place
+    struct paged_file* paged;
 };
 
 int open_file_buffer(struct file_buffer* fb, const char* path);
 void close_file_buffer(struct file_buffer* fb); // not auto save! call save_file_buffer first!!!!!
 
-int save_file_buffer(struct file_buffer* fb);
+int save_file_buffer(struct file_buffer* fb); // writes a temp file next to the original and renames it over
 
 // to have shorter names for these i will prefix them 'fb' short for 'file_buffer'
 
@@ -34,4 +132,88 @@ void fb_insert_char(struct file_buffer* fb, int line, char c);
 
 void fb_delete_char(struct file_buffer* fb, int line); // silently ignore if out of bounds
 
+void fb_delete_chars(struct file_buffer* fb, int line, int count); // count of them, as far as the line goes
+
+// inserts len bytes at the line's gap like that many fb_insert_char calls would, except every '\n' starts
+// a new line. the gap ends up right after the text, on the last line. returns how many lines were added,
+// -1 if out of bounds, OOM or the text has a newline and the file is paged
+int fb_insert_str(struct file_buffer* fb, int line, const char* text, int len);
+
+// line operations, O(log n) in the number of lines. -1 if out of bounds, OOM or the file is paged
+
+int fb_split_line(struct file_buffer* fb, int line, int col); // everything from col on becomes a new line below
+int fb_join_lines(struct file_buffer* fb, int line); // appends the next line to this one
+int fb_delete_lines(struct file_buffer* fb, int line, int count); // deleting everything leaves one empty line
+int fb_insert_line(struct file_buffer* fb, int line, const char* text, int len); // before line, line_count appends
+
+int fb_read_line(struct file_buffer* fb, int line, char* out); // copies the line into out, fb_line_length bytes
+
+struct fb_damage fb_take_damage(struct file_buffer* fb); // and starts collecting from scratch
+
+// soft wrap. a line takes up ceil(display width / wrap width) screen rows, at least 1. all of these are O(log n),
+// except the first call after the width changed
+
+void fb_set_wrap_width(struct file_buffer* fb, int width);
+
+int fb_line_rows(struct file_buffer* fb, int line);
+int fb_rows_before(struct file_buffer* fb, int line); // the row the line starts at
+int fb_total_rows(struct file_buffer* fb);
+
+int fb_line_at_row(struct file_buffer* fb, int row, int* row_in_line); // clamps
+
+// display columns. a col is a byte offset into the line, a vcol the column on screen counted from the start
+// of the line, soft wrapped rows included. all O(log n) in the line's length once it's been looked at
+
+int fb_line_width(struct file_buffer* fb, int line);
+int fb_col_to_vcol(struct file_buffer* fb, int line, int col); // the column the char at col starts in
+int fb_vcol_to_col(struct file_buffer* fb, int line, int vcol); // start of the char covering vcol, clamps
+
+// the next and previous char in the line. zero width ones get skipped, they go with the char before them
+int fb_next_char(struct file_buffer* fb, int line, int col);
+int fb_prev_char(struct file_buffer* fb, int line, int col);
+
+// what the lines take up. live is the text itself, slack whatever else is held for it: gaps, rounding up
+// to a size class, and slab slots lines have outgrown. pooled is free in the pool for the next lines
+struct fb_memory {
+    size_t live;
+    size_t slack;
+    size_t pooled;
+};
+
+struct fb_memory fb_memory(struct file_buffer* fb);
+
+// idle time housekeeping. once enough slack has piled up, lines that weren't edited lately are moved into
+// the smallest buffer that holds them and pool chunks nothing uses anymore are given back. a call looks at
+// budget lines at most, so a pass over a big file gets spread out. true while the pass isn't done
+bool fb_compact(struct file_buffer* fb, int budget);
+bool fb_compact_pending(struct file_buffer* fb); // whether fb_compact has anything to do
+
+// the lines as they are right now, for writing them out on another thread while editing goes on. taking one
+// only copies the line table, not the text. until it's released a line gets a buffer of its own before
+// anything writes to it and buffers that would be freed are kept, so nothing the snapshot points at changes.
+// lines that are edited while it's out get copied once per edit, which is fine for as long as a write takes
+struct fb_snapshot {
+    struct line_buffer* lines;
+    int count;
+    int cap; // lines is reused by the next snapshot
+    const char* text_end; // views end in the text's own newline unless they're at the very end
+};
+
+int fb_snapshot_take(struct file_buffer* fb, struct fb_snapshot* snap); // -1 if paged, OOM or one is still out
+void fb_snapshot_release(struct file_buffer* fb, struct fb_snapshot* snap); // main thread, snap can be taken again
+void fb_snapshot_free(struct fb_snapshot* snap);
+
+int fb_snapshot_write(const struct fb_snapshot* snap, int fd); // the file save_file_buffer would write. any thread
+
+#define FB_FIND_MAX 256
+
+// column of the first match starting at or after from, or backward the last one starting before it. -1 if
+// there's none. the line is searched where it lies, so this is about as fast as a memmem over it
+int fb_find(struct file_buffer* fb, int line, const char* needle, int len, int from, bool backward);
+
+// paged files are indexed in the background and line_count grows while that happens. the fd becomes
+// readable whenever there's more, -1 if there's never anything to wait for
+int fb_index_fd(struct file_buffer* fb);
+void fb_index_progress(struct file_buffer* fb);
+
 #endif //FILEBUF_H
\ No newline at end of file
@@ -0,0 +1,74 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef HIGHLIGHT_H
+#define HIGHLIGHT_H 1
+
+#include "filebuf.h"
+#include "terminal.h"
+
+#include <stdint.h>
+
+// syntax highlighting. a lexer colors one line at a time, starting in whatever state the line above ended
+// in (inside a block comment and so on), and the state every line ends in is cached. after an edit only the
+// lines from the first changed one on get lexed again, and only until one ends the same way it did before,
+// nothing past that can have changed
+
+enum hl_class {
+    HL_NORMAL,
+    HL_KEYWORD,
+    HL_TYPE,
+    HL_STRING,
+    HL_NUMBER,
+    HL_COMMENT,
+    HL_PREPROC,
+    HL_CLASS_COUNT,
+};
+
+struct hl_lexer {
+    const char* name;
+    const char* const* extensions; // NULL terminated, dot included
+
+    // lexes a line starting in state and returns the state it ends in. classes gets one hl_class per byte,
+    // unless it's NULL and only the state is wanted. state 0 is the start of the file
+    uint8_t (*lex)(uint8_t state, const char* text, int len, uint8_t* classes);
+};
+
+extern const struct hl_lexer hl_lexer_c;
+
+const struct hl_lexer* hl_lexer_for(const char* path); // by extension, NULL if there's none
+
+struct highlight {
+    const struct hl_lexer* lexer; // NULL highlights nothing
+
+    uint8_t* states; // the state each line ends in
+    int count; // line_count as of the last update
+    int cap;
+
+    int valid; // states of the lines before this are right
+    // states in [converge, known) were right before an edit above them, and still are once the
+    // line in front of them ends the way it used to
+    int converge;
+    int known;
+
+    char* text; // the line being lexed and its classes
+    uint8_t* classes;
+    int text_cap;
+};
+
+void hl_init(struct highlight* hl, const struct hl_lexer* lexer);
+void hl_free(struct highlight* hl);
+
+// call with every fb_take_damage before asking for lines again. -1 on OOM, everything gets lexed again then
+int hl_update(struct highlight* hl, const struct fb_damage* damage, int line_count);
+
+// classes for each byte of the line, valid until the next call. NULL if there's no lexer or it's OOM
+const uint8_t* hl_line(struct highlight* hl, struct file_buffer* fb, int line);
+
+// an edit can change the colors of lines after it too, like opening a block comment does. this lexes on
+// from the first line hl_update made unsure, up to limit at most, until one ends the way it did before.
+// returns the line from which on nothing looks different than it did, 0 if nothing does
+int hl_changed_until(struct highlight* hl, struct file_buffer* fb, int limit);
+
+struct color hl_color(enum hl_class class);
+
+#endif //HIGHLIGHT_H
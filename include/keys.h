@@ -0,0 +1,72 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef KEYS_H
+#define KEYS_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// turns raw terminal input into keys. bytes go into a ring buffer as they're read and keys come out once
+// they're complete, however the reads split them up. a lone escape could be the start of a sequence that
+// hasn't all arrived yet, so it only counts as the escape key once nothing else followed for a moment
+
+#define KEYS_RING 4096 // power of 2
+#define KEYS_ESCAPE_TIMEOUT 25 // ms
+#define KEYS_SEQ_MAX 32 // anything longer that still hasn't ended isn't a sequence
+#define KEYS_PASTE_TIMEOUT 500 // ms of nothing in the middle of a paste before it's taken as it is, end marker or not
+
+enum key_type {
+    KEY_CHAR, // one byte of typed text, utf-8 comes in a byte at a time
+    KEY_ESCAPE,
+    KEY_UP,
+    KEY_DOWN,
+    KEY_RIGHT,
+    KEY_LEFT,
+    KEY_HOME,
+    KEY_END,
+    KEY_DELETE,
+    KEY_PAGE_UP,
+    KEY_PAGE_DOWN,
+    KEY_PASTE, // all of a bracketed paste at once, as it came
+};
+
+struct key {
+    enum key_type type;
+    char c; // KEY_CHAR
+
+    char* text; // KEY_PASTE, the caller can change it in place. valid until the next keys_next
+    int len;
+};
+
+struct key_decoder {
+    char ring[KEYS_RING];
+    uint32_t head; // next byte to decode
+    uint32_t tail; // where the next one read goes
+
+    int64_t pending_since; // ms, when decoding first stopped at an unfinished sequence. -1 if it didn't
+
+    bool pasting;
+    int64_t paste_heard; // ms, when the paste last got any more of itself
+    char* paste;
+    int paste_len;
+    int paste_cap;
+};
+
+void keys_init(struct key_decoder* kd);
+void keys_free(struct key_decoder* kd);
+
+int keys_room(const struct key_decoder* kd);
+void keys_feed(struct key_decoder* kd, const char* data, int len); // at most keys_room bytes
+
+// the next complete key, false if there's none yet. now is in ms, see keys_timeout
+bool keys_next(struct key_decoder* kd, struct key* key, int64_t now);
+
+// ms until whatever is left undecoded gets taken as typed as it is (or an unfinished paste as it is), -1 if
+// there's nothing waiting for that
+int keys_timeout(const struct key_decoder* kd, int64_t now);
+
+bool keys_pasting(const struct key_decoder* kd); // in the middle of a paste, the rest is on its way
+
+int64_t keys_now(void); // monotonic ms
+
+#endif //KEYS_H
@@ -0,0 +1,39 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef LINEPOOL_H
+#define LINEPOOL_H 1
+
+#include <stddef.h>
+
+// where the gap buffers of edited lines come from. sizes get rounded up to one of a few size classes, each
+// with its own free list, and are carved out of big chunks, so a line doesn't cost a malloc header and a
+// freed buffer goes to the next line of about its size. anything over LP_MAX is malloc'd as it is.
+// only filebuf.c and paged.c should need this
+
+#define LP_CHUNK (256 << 10) // power of 2, chunks are aligned to it
+#define LP_MAX (16 << 10)
+#define LP_CLASSES 36 // 16 to 128 in steps of 16, then 4 steps per power of 2 up to LP_MAX
+
+struct lp_chunk;
+
+struct line_pool {
+    char* free[LP_CLASSES]; // each free buffer starts with a pointer to the next one
+    struct lp_chunk* chunks; // newest first
+    char* bump; // what's left of the newest chunk
+    char* bump_end;
+
+    size_t chunk_bytes;
+    size_t in_use; // of chunk_bytes
+};
+
+void lp_init(struct line_pool* lp);
+void lp_destroy(struct line_pool* lp); // everything over LP_MAX has to be lp_free'd first
+
+int lp_size(int size); // what lp_alloc rounds size up to
+
+char* lp_alloc(struct line_pool* lp, int size); // lp_size(size) bytes, NULL on OOM
+void lp_free(struct line_pool* lp, char* buf, int size); // size is the lp_size it got, NULL is fine
+
+void lp_trim(struct line_pool* lp); // gives back chunks none of whose buffers are in use
+
+#endif //LINEPOOL_H
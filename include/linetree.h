@@ -0,0 +1,49 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef LINETREE_H
+#define LINETREE_H 1
+
+#include "filebuf.h"
+
+// the lines of a file_buffer live in a counted b+tree. leaves hold the line_buffers themselves, every
+// node knows how many lines and wrapped screen rows are below it, so finding a line by number or by
+// screen row, inserting and removing lines are all O(log n). only filebuf.c should need this
+
+#define LEAF_MAX 64
+#define NODE_MAX 32
+
+struct line_node {
+    bool leaf;
+    int count; // used entries in line or child
+    int lines;
+    int rows; // at the file_buffer's wrap width, garbage while rows_stale is set
+
+    union {
+        struct {
+            struct line_buffer line[LEAF_MAX];
+            int line_rows[LEAF_MAX]; // each line's rows, so finding one in a leaf doesn't measure them all
+        };
+        struct line_node* child[NODE_MAX];
+    };
+};
+
+int lt_build(struct file_buffer* fb, struct line_buffer* lines, int count); // takes over the line_buffers, not the array
+void lt_free(struct file_buffer* fb);
+
+struct line_buffer* lt_get(struct file_buffer* fb, int line); // NULL if out of bounds
+
+int lt_insert(struct file_buffer* fb, int line, const struct line_buffer* lb); // before line, line_count appends
+int lt_remove(struct file_buffer* fb, int line, struct line_buffer* out); // the removed line goes into out
+
+void lt_line_changed(struct file_buffer* fb, int line, int old_rows); // call after a line changed, with its rows from before
+
+// stops and returns fn's result as soon as that isn't 0
+int lt_for_each(struct file_buffer* fb, int (*fn)(struct line_buffer* line, void* ctx), void* ctx);
+
+void lt_invalidate_rows(struct file_buffer* fb); // wrap width changed
+int lt_rows_before(struct file_buffer* fb, int line);
+int lt_line_at_row(struct file_buffer* fb, int row, int* row_in_line);
+
+int lt_line_rows(struct file_buffer* fb, const struct line_buffer* lb);
+
+#endif //LINETREE_H
@@ -0,0 +1,115 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef PAGED_H
+#define PAGED_H 1
+
+#include "filebuf.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// backend for files too big to index line by line. the file is read in fixed size pages, a background
+// thread counts how many lines start in each page and only the pages something looks at get decoded,
+// into a small lru cache. edited lines become overlays that shadow the file until it's saved.
+// memory is the cache, the overlays and a few bytes per page, however big the file is.
+// only filebuf.c should need this
+
+#define PAGE_BYTES (1 << 20)
+#define PAGE_CACHE_MAX 64
+#define LINE_CACHE_MAX 256
+#define OVERLAY_MAX_LINE (16 << 20) // longer lines can't be edited in paged mode
+
+// a decoded page, its bytes and where the lines starting in it start
+struct page {
+    int64_t index; // -1 if the slot is free
+    char* data;
+    int size;
+
+    int* starts;
+    int start_count;
+    int start_cap;
+
+    struct page* prev; // lru order, head was used last
+    struct page* next;
+};
+
+// an edited line, shadows the original bytes at start
+struct line_overlay {
+    int line;
+    uint64_t start;
+    int orig_len;
+    struct line_buffer lb;
+};
+
+struct line_slot {
+    int line; // -1 if empty
+    uint64_t start;
+    int len;
+};
+
+struct paged_file {
+    int fd; // stays the original file even after saving, the overlays are relative to it
+    uint64_t size;
+    bool ends_with_newline;
+    int64_t page_count;
+
+    // written by the indexer thread for every page before it publishes it through indexed
+    uint32_t* page_lines; // lines that start in each page
+    int64_t* first_line; // lines that start before each page, page_count + 1 of them
+    _Atomic int64_t indexed;
+    atomic_bool stop;
+    pthread_t thread;
+    bool thread_running;
+    uint32_t carry; // from the first page, which pg_open indexes itself
+    int notify[2]; // a byte every so often while indexing, and one when it's done
+
+    int64_t seen; // pages main thread has picked up so far
+
+    // wrapped rows per page in a fenwick tree. pages nobody has looked at yet are guessed at one row
+    // per line, they're counted for real when they get decoded
+    int64_t* row_tree;
+    int64_t* page_rows;
+    int* page_width; // the wrap width page_rows was counted at, 0 for a guess
+
+    struct page pages[PAGE_CACHE_MAX];
+    struct page* lru_head;
+    struct page* lru_tail;
+
+    struct line_slot line_cache[LINE_CACHE_MAX];
+
+    struct line_overlay* overlays; // sorted by line
+    int overlay_count;
+    int overlay_cap;
+
+    // where fb_set_cursor_pos last put the cursor on a line without an overlay, its gap starts there
+    int cursor_line;
+    int cursor_col;
+};
+
+bool pg_wants(size_t size); // whether a file this big should be opened paged
+
+int pg_open(struct file_buffer* fb, size_t size);
+void pg_close(struct file_buffer* fb);
+
+int pg_index_fd(struct file_buffer* fb);
+void pg_index_progress(struct file_buffer* fb); // updates line_count with whatever got indexed since
+
+struct line_buffer* pg_overlay(struct file_buffer* fb, int line); // NULL if the line wasn't edited
+struct line_buffer* pg_add_overlay(struct file_buffer* fb, int line, const struct line_buffer* lb);
+
+char pg_char_at(struct file_buffer* fb, int line, int col); // the original bytes, overlays aside
+int pg_line_length(struct file_buffer* fb, int line);
+int pg_read_line(struct file_buffer* fb, int line, char* out); // copies the original line into out
+
+void pg_line_changed(struct file_buffer* fb, int line, int old_rows);
+
+int pg_write(struct file_buffer* fb, int fd); // streams the file with the overlays applied into fd
+
+void pg_set_wrap_width(struct file_buffer* fb);
+int pg_line_rows(struct file_buffer* fb, int line);
+int pg_rows_before(struct file_buffer* fb, int line);
+int pg_total_rows(struct file_buffer* fb);
+int pg_line_at_row(struct file_buffer* fb, int row, int* row_in_line);
+
+#endif //PAGED_H
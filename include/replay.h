@@ -0,0 +1,55 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef REPLAY_H
+#define REPLAY_H 1
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// recorded keystrokes. a script is a text file with one chunk of input per line, the way it was read from
+// the terminal, and how many ms after the one before it came in:
+//
+//   # comments and empty lines are skipped
+//   0 ihello world\e
+//   250 :w\r
+//
+// \e, \r, \n, \t, \\ and \xHH are escapes, everything else is taken as it is. replaying writes the chunks
+// into a pipe on their own thread, so the editor reads them just like it would a terminal
+
+struct replay_chunk {
+    int delay; // ms
+    int start; // in data
+    int len;
+};
+
+struct replay {
+    char* data;
+    struct replay_chunk* chunks;
+    int count;
+
+    int fd[2]; // the editor reads fd[0], it hits eof once the script is done
+    pthread_t thread;
+    bool thread_running;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool stop;
+};
+
+int replay_open(struct replay* r, const char* path); // -1 if it can't be read or parsed, says why on stderr
+void replay_close(struct replay* r);
+
+int replay_fd(struct replay* r);
+
+struct recorder {
+    FILE* file;
+    int64_t last; // ms, when the last chunk came in
+};
+
+int record_open(struct recorder* rec, const char* path);
+void record_close(struct recorder* rec);
+
+void record_input(struct recorder* rec, const char* data, int len); // one chunk, as it was read
+
+#endif //REPLAY_H
@@ -0,0 +1,26 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef SCAN_H
+#define SCAN_H 1
+
+#include <stddef.h>
+
+// vectorized byte scanning. uses avx2 or sse2 where the cpu has them, plain c everywhere else
+
+// stores the offsets of the '\n's in text[*pos, size) into out, at most cap of them.
+// returns how many were stored and leaves *pos where it stopped, so keep calling until *pos == size
+size_t scan_newlines(const char* text, size_t size, size_t* pos, size_t* out, size_t cap);
+
+// first/last place needle shows up in text[0, size), NULL if it doesn't
+const char* scan_find(const char* text, size_t size, const char* needle, size_t len);
+const char* scan_find_last(const char* text, size_t size, const char* needle, size_t len);
+
+// how many bytes from the start are plain printable ascii (0x20 to 0x7e), one column each on screen
+size_t scan_plain(const char* text, size_t size);
+
+// where a[0, size) and b[0, size) first differ, size if they don't. and one past where they last differ, 0 if
+// they don't
+size_t scan_mismatch(const void* a, const void* b, size_t size);
+size_t scan_mismatch_last(const void* a, const void* b, size_t size);
+
+#endif //SCAN_H
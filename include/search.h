@@ -0,0 +1,49 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef SEARCH_H
+#define SEARCH_H 1
+
+#include "filebuf.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+// / and ? search. finding the next match happens right away, counting all of them is done by a
+// worker thread a chunk of lines at a time, so a long count never holds up typing. the worker and
+// main take turns on the file_buffer through lock, main holds it for as long as it's doing a frame
+
+struct search {
+    char pattern[FB_FIND_MAX];
+    int len; // 0 when there's no pattern
+    bool backward; // the last search was a ?
+
+    struct file_buffer* fb;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t thread;
+    bool quit;
+    atomic_bool main_waiting; // the worker lets go of lock between chunks when this is set
+
+    unsigned long generation; // bumped whenever the pattern changes
+    unsigned long counted_changes; // fb->changes and line_count the last count was for
+    int counted_lines;
+    long count; // -1 while counting
+    int notify[2]; // a byte when a count is done
+};
+
+int search_init(struct search* s, struct file_buffer* fb);
+void search_destroy(struct search* s);
+
+void search_lock(struct search* s);
+void search_unlock(struct search* s); // also restarts the count if the file changed while main had it
+
+int search_fd(struct search* s);
+void search_drain(struct search* s);
+
+void search_set_pattern(struct search* s, const char* pattern, int len, bool backward);
+
+// the next match from line:col, wrapping around the end of the file. 0 and the match, -1 if there's none
+int search_find(struct search* s, int line, int col, bool backward, int* out_line, int* out_col);
+
+#endif //SEARCH_H
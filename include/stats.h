@@ -0,0 +1,51 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef STATS_H
+#define STATS_H 1
+
+#include <stdint.h>
+
+// counters and latency histograms for whatever makes the editor feel slow: frames, drawing them, writing
+// them out, loading and saving. always on, timing something is two clock reads and a few adds, so it's
+// there when someone says it's laggy and not just when it's being profiled. main thread only
+
+#define STATS_BUCKETS 24 // bucket i has what took under 2^i us, the last one everything past that too
+
+enum stats_timer {
+    STATS_FRAME, // from the frame waking up to its last byte being written
+    STATS_LAYOUT, // putting the frame's cells together after its keys were handled
+    STATS_DIFF, // comparing them with the last frame and turning what changed into escapes
+    STATS_WRITE, // handing a flush to the terminal, however many write calls that took
+    STATS_LOAD,
+    STATS_SAVE,
+    STATS_TIMER_COUNT,
+};
+
+enum stats_counter {
+    STATS_CELLS, // cells redrawn because they changed, an erase counts all it covers
+    STATS_BYTES, // written to the terminal, text and escapes
+    STATS_WRITES, // write calls that took, headless terminals count one per flush
+    STATS_COUNTER_COUNT,
+};
+
+struct stats_histogram {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t buckets[STATS_BUCKETS];
+};
+
+int64_t stats_now(void); // ns, monotonic
+
+void stats_time(enum stats_timer timer, int64_t start); // takes start from stats_now, ends it now
+void stats_count(enum stats_counter counter, uint64_t n);
+
+const struct stats_histogram* stats_histogram(enum stats_timer timer);
+uint64_t stats_counter(enum stats_counter counter);
+
+int64_t stats_percentile(enum stats_timer timer, int percent); // ns, the top of the bucket it's in. 0 if nothing
+
+int stats_summary(char* out, int size); // fits in one status line, returns its length like snprintf
+int stats_dump(const char* path); // everything as json, -1 if it can't be written
+
+#endif //STATS_H
@@ -0,0 +1,60 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef SWAP_H
+#define SWAP_H 1
+
+#include "filebuf.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+// swap files, so a crash loses a few seconds of typing instead of everything since the file was opened.
+// once the buffer has changed and been left alone for a moment, or has kept changing for long enough, main
+// takes a snapshot of it (see fb_snapshot_take) and a thread writes that to .name.swp next to the file.
+// a clean exit removes it, so finding one at startup means the run before didn't get that far. paged files
+// don't get one, they're too big to write out every few seconds
+
+#define SWAP_IDLE 2000 // ms since the last change
+#define SWAP_MAX_WAIT 30000 // ms a buffer that never stops changing goes without one
+
+struct swap_info {
+    int pid; // of the editor that wrote it
+    bool pid_alive; // which may still have the file open
+    time_t written;
+    bool stale; // the file was written after it, probably saved by something else
+};
+
+struct swap {
+    struct file_buffer* fb;
+    char* path; // NULL if the file doesn't get one
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool quit;
+    bool busy; // a write is going on
+    bool failed; // the last one didn't make it to disk
+    bool snap_out; // snap is taken, main releases it once the thread says snap_done
+    bool snap_done;
+    struct fb_snapshot snap;
+    int notify[2]; // a byte when the thread is done with the snapshot and when it's done writing
+
+    unsigned long seen_changes; // fb->changes the last tick saw
+    int64_t pending_since; // ms, when the buffer got ahead of the swap file, -1 if it isn't
+    int64_t last_change; // ms
+};
+
+int swap_init(struct swap* s, struct file_buffer* fb); // -1 if there's no thread to write with
+void swap_destroy(struct swap* s, bool keep); // waits for a write going on. the file is removed unless keep
+
+int swap_fd(struct swap* s);
+int swap_timeout(struct swap* s, int64_t now); // ms until swap_tick has something to do, -1 if nothing will
+void swap_tick(struct swap* s, int64_t now); // main, while it has the buffer. now from keys_now
+
+// what the run before left behind. 0 and what's known about it if there's a swap file for this one
+int swap_find(struct swap* s, struct swap_info* info);
+int swap_recover(struct swap* s); // the buffer becomes what's in the swap file, -1 if it can't be read
+void swap_discard(struct swap* s);
+
+#endif //SWAP_H
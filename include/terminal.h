@@ -4,6 +4,7 @@
 #define TERMINAL_H 1
 
 #include <stdbool.h>
+#include <stddef.h>
 
 // https://github.com/raysan5/raylib/blob/master/src/raylib.h#L147
 #if defined(__cplusplus)
@@ -21,6 +22,28 @@ struct dimensions {
     int height;
 };
 
+// where the output goes and the input and size come from. the tty is the real terminal on stdin and stdout,
+// the virtual one keeps everything written to it in memory (see term_captured) and null throws it away.
+// neither of those has any input or size of their own, see term_use and term_set_input_fd
+struct term_backend {
+    const char* name;
+    void (*init)(void);
+    void (*restore)(void); // the way init found things, at exit
+    void (*set_raw)(bool raw);
+    void (*write)(const char* data, size_t len); // all of it
+    bool (*get_size)(struct dimensions* size); // false if it doesn't know
+    int (*input_fd)(void); // -1 if there's none
+};
+
+extern const struct term_backend term_tty;
+extern const struct term_backend term_virtual;
+extern const struct term_backend term_null;
+
+const struct term_backend* term_backend_named(const char* name); // NULL if there's no such one
+
+void term_use(const struct term_backend* backend, struct dimensions size); // before term_init, the tty is the default
+const struct term_backend* term_backend(void);
+
 void term_init(void); // initialize internal state and shit
 
 void term_force_update_size(void);
@@ -28,14 +51,42 @@ struct dimensions term_get_size(void);
 
 void term_resize_handler(void (*cb)(void));
 
+int term_input_fd(void); // where keys come from, poll and read it
+void term_set_input_fd(int fd); // keys come from fd instead of the backend, like when replaying. -1 undoes it
+
+size_t term_bytes_written(void); // everything that went to the backend so far
+const char* term_captured(size_t* len); // everything the virtual terminal got so far
+
+// SIGWINCH only makes this fd readable. poll it next to stdin and call term_handle_resize when it is,
+// the resize handler runs from there and not in signal context
+int term_resize_fd(void);
+bool term_handle_resize(void); // true if there was a resize
+
+// raw mode also turns on bracketed paste, pasted text comes in between these two instead of looking typed
+#define TERM_PASTE_START "\x1b[200~"
+#define TERM_PASTE_END "\x1b[201~"
+#define TERM_PASTE_MARKER_LEN 6
+
 void term_enable_raw(void);
 void term_disable_raw(void);
 
 void term_set_cursor_pos(int line, int col);
+void term_cursor_forward(int n);
 
 void term_clear(void);
 void term_move_home(void);
 
+void term_erase_line_end(void); // from the cursor to the end of the line
+void term_erase_chars(int n); // n cells starting at the cursor, which doesn't move
+
+// lines only move within the scroll region, rows top to bottom counting from 1. setting it or resetting it
+// to the whole screen puts the cursor home. inserting and deleting lines happens at the cursor's row, what's
+// below moves down or up and blank lines come in at the cursor or the bottom of the region
+void term_set_scroll_region(int top, int bottom);
+void term_reset_scroll_region(void);
+void term_insert_lines(int n);
+void term_delete_lines(int n);
+
 void term_hide_cursor(void);
 void term_show_cursor(void);
 
@@ -56,9 +107,15 @@ void term_fmt_color_bg_reset(void);
 void term_fmt_color_fg(struct color c);
 void term_fmt_color_bg(struct color c);
 
+void term_fmt_sgr(const int* params, int count); // any mix of the above in one sequence, count 0 resets
+
 // write
+// everything above and below is buffered, nothing reaches the terminal until term_flush.
+// tui_render flushes at the end of every frame, anything drawing outside of it has to flush itself
 
 void term_write(char c);
 void term_write_str(const char* str, int len);
 
+void term_flush(void);
+
 #endif //TERMINAL_H
\ No newline at end of file
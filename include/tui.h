@@ -6,17 +6,52 @@
 #include "terminal.h"
 
 #include <stdbool.h>
+#include <stdint.h>
+
+// a screen cell is one 64 bit word, the codepoint in the low 21 bits and its style above that:
+// attribute bits, then a 16 bit foreground and a 16 bit background color. a style is a cell without
+// the codepoint, so putting a styled char is just or'ing the two together
+
+typedef uint64_t tui_style;
+typedef uint16_t tui_color;
+
+// 0 is the terminal's own color, TUI_ANSI the 256 color palette and tui_rgb hands out the rest
+#define TUI_DEFAULT ((tui_color) 0)
+#define TUI_ANSI(n) ((tui_color) (1 + (n)))
+#define TUI_RGB_MAX 4096 // distinct 24 bit colors there can be, tui_rgb gives TUI_DEFAULT after that
+
+#define TUI_BOLD          ((tui_style) 1 << 24)
+#define TUI_FAINT         ((tui_style) 1 << 25)
+#define TUI_ITALIC        ((tui_style) 1 << 26)
+#define TUI_UNDERLINE     ((tui_style) 1 << 27)
+#define TUI_BLINK         ((tui_style) 1 << 28)
+#define TUI_INVERT        ((tui_style) 1 << 29)
+#define TUI_STRIKETHROUGH ((tui_style) 1 << 30)
+
+#define TUI_FG(color) ((tui_style) (color) << 32)
+#define TUI_BG(color) ((tui_style) (color) << 48)
 
 void tui_init(void);
 void tui_destroy(void);
 
 struct dimensions tui_get_screen_size(void);
 
+tui_color tui_rgb(struct color c);
+
+// rows only get compared with what's on the terminal if something was written to them since the last
+// render, so a frame that leaves most of them alone costs next to nothing for those
 void tui_clear(void);
+void tui_clear_rows(int from, int to); // blanks rows [from, to) to be drawn again
+bool tui_row_dirty(int y);
+
+// rows [from, to) move up n rows, or down -n, on the terminal itself instead of being sent again. what goes
+// off the end is gone and the rows that come in are blank and dirty. before anything is put this frame
+void tui_scroll(int from, int to, int n);
 
-void tui_put(int x, int y, char c);
+void tui_put(int x, int y, char c); // keeps the cell's style
+void tui_put_styled(int x, int y, uint32_t ch, tui_style style);
 void tui_set_invert(int x, int y, bool invert);
 
 void tui_render(void);
 
-#endif //TUI_H
\ No newline at end of file
+#endif //TUI_H
@@ -0,0 +1,48 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef UNDO_H
+#define UNDO_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct file_buffer;
+
+// journal of everything done to a file_buffer, as records appended to one arena. undoing walks
+// back over the last group of records and applies their inverse, so it costs as much as the edit
+// did and not a byte more. records after top are the ones that can be redone
+
+#define UNDO_DEFAULT_MAX (32 << 20)
+
+struct undo_journal {
+    char* data;
+    size_t len;
+    size_t cap;
+    size_t top;
+    size_t max; // once the arena goes over this the oldest groups are dropped
+
+    uint32_t group; // records with the same group are undone together
+};
+
+void undo_init(struct undo_journal* j, size_t max);
+void undo_free(struct undo_journal* j);
+
+void undo_begin(struct undo_journal* j); // whatever gets recorded from now on is a new undo step
+
+// filebuf.c calls these for every change while the file_buffer has a journal attached.
+// consecutive inserts (or deletes) at the same spot in one group go into one record
+
+void undo_record_insert(struct undo_journal* j, int line, int col, char c);
+void undo_record_insert_str(struct undo_journal* j, int line, int col, const char* text, int len);
+void undo_record_delete(struct undo_journal* j, int line, int col, char c);
+void undo_record_delete_str(struct undo_journal* j, int line, int col, const char* text, int len);
+void undo_record_split(struct undo_journal* j, int line, int col);
+void undo_record_join(struct undo_journal* j, int line, int col);
+void undo_record_delete_lines(struct undo_journal* j, struct file_buffer* fb, int line, int count, int placeholder);
+void undo_record_insert_line(struct undo_journal* j, int line, const char* text, int len);
+
+// 0 and where the cursor should go, -1 if there's nothing to undo/redo
+int undo_undo(struct undo_journal* j, struct file_buffer* fb, int* line, int* col);
+int undo_redo(struct undo_journal* j, struct file_buffer* fb, int* line, int* col);
+
+#endif //UNDO_H
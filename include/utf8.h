@@ -0,0 +1,32 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef UTF8_H
+#define UTF8_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// lines are kept as the bytes they are, utf-8 or not. this is how they turn into codepoints and
+// screen columns. a tab goes to the next multiple of UTF8_TAB_WIDTH, control chars show up as ^X,
+// bytes that aren't valid utf-8 as one U+FFFD each, and a wide char that would be split by the end
+// of a row starts on the next one instead
+
+#define UTF8_TAB_WIDTH 4
+#define UTF8_INVALID 0xFFFD
+
+int utf8_decode(const char* text, int len, uint32_t* cp); // bytes the char takes, at least 1 unless len is 0
+int utf8_encode(uint32_t cp, char* out); // out needs room for 4
+
+bool utf8_continuation(char c);
+
+int utf8_width(uint32_t cp); // 0, 1 or 2, not counting tabs and control chars
+
+// lays out a line given as the two halves around its gap. the i-th char starts at byte starts[i] and
+// column vcols[i], and there's one more entry at the end for the whole line. either can be NULL.
+// returns the number of chars, the line's width in columns goes into *width
+int utf8_layout(const char* a, int a_len, const char* b, int b_len, int wrap, int* starts, int* vcols, int* width);
+
+// the width alone, and a lot quicker for the usual line that's all plain ascii
+int utf8_line_width(const char* a, int a_len, const char* b, int b_len, int wrap);
+
+#endif //UTF8_H
@@ -0,0 +1,21 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef WORKERS_H
+#define WORKERS_H 1
+
+#include <stddef.h>
+
+// a few threads for one big job that splits into independent parts, like indexing a file that's just been
+// loaded. they're started for the job and gone once it's done, there's nothing running in between
+
+#define WORKERS_MAX 32
+
+// how many parts size bytes of work should be split into, at least min_part each and no more than there
+// are cores. 1 means it's not worth any threads
+int workers_for(size_t size, size_t min_part);
+
+// job(ctx, part) for every part in [0, parts), each on its own thread and the first on the caller's.
+// returns once they're all done. parts that don't get a thread run on the caller after the first
+void workers_run(int parts, void (*job)(void* ctx, int part), void* ctx);
+
+#endif //WORKERS_H
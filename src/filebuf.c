@@ -1,16 +1,39 @@
 // Copyright 2025 JesusTouchMe
 
 #include "filebuf.h"
+#include "linetree.h"
+#include "paged.h"
+#include "scan.h"
+#include "stats.h"
+#include "undo.h"
+#include "utf8.h"
+#include "workers.h"
 
 #include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <unistd.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define GAP_INIT 32
 
+#define SLAB_GAP 8
+#define SLAB_MAX_FILE (64 << 20) // anything bigger stays mapped instead of being copied into the slab
+
+#define INDEX_BATCH 4096
+#define INDEX_PART_MIN (16 << 20) // bytes, smaller files are indexed on the one thread
+
+#define SAVE_IOV 1024 // IOV_MAX on linux
+
+#define COMPACT_MIN_WASTE (64 << 10) // a pass starts once slack and pooled grew by this or live / 16 if that's more
+
 static char* read_all(int fd, size_t* out_size) {
     size_t cap = 4096;
     size_t size = 0;
@@ -42,101 +65,554 @@ static char* read_all(int fd, size_t* out_size) {
     return buf;
 }
 
+static int load_text(struct file_buffer* fb) {
+    struct stat st;
+    if (fstat(fb->fd, &st) < 0) return -1;
+
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fb->fd, 0);
+        if (map != MAP_FAILED) {
+            fb->text = map;
+            fb->text_size = st.st_size;
+            fb->text_mapped = true;
+            return 0;
+        }
+    }
+
+    // not mappable (empty, special file, weird fs), take the slow road
+    fb->text = read_all(fb->fd, &fb->text_size);
+    fb->text_mapped = false;
+    return fb->text == NULL ? -1 : 0;
+}
+
+static void free_text(struct file_buffer* fb) {
+    if (fb->text_mapped) munmap(fb->text, fb->text_size);
+    else free(fb->text);
+
+    fb->text = NULL;
+    fb->text_size = 0;
+    fb->text_mapped = false;
+}
+
+// the lines as the loader finds them, handed over to the line tree once they're all there
+struct line_list {
+    struct line_buffer* lines;
+    int count;
+    int cap;
+};
+
+static void view_line(struct line_buffer* line, char* start, int len) {
+    line->buf = start;
+    line->len = len;
+    line->gap_start = len;
+    line->gap_end = len;
+    line->storage = LINE_VIEW;
+}
+
+static int add_line(struct line_list* list, char* start, int len) {
+    if (list->count == list->cap) {
+        int new_cap = list->cap * 2;
+        struct line_buffer* tmp = realloc(list->lines, new_cap * sizeof(struct line_buffer));
+        if (tmp == NULL) return -1;
+
+        list->lines = tmp;
+        list->cap = new_cap;
+    }
+
+    view_line(&list->lines[list->count++], start, len);
+    return 0;
+}
+
+// a big file is cut into parts at arbitrary bytes. each worker counts the newlines in its part, then the
+// lines ending in it are numbered from the counts before, and each worker fills in its own. the first line
+// ending in a part started after the last newline in some part before it, that's all that needs stitching
+struct index_job {
+    char* text;
+    size_t bounds[WORKERS_MAX + 1]; // part i is text[bounds[i], bounds[i + 1])
+    int newlines[WORKERS_MAX];
+    size_t last[WORKERS_MAX]; // one past the part's last newline, 0 if it has none
+    int first[WORKERS_MAX]; // the first line ending in the part
+    size_t start[WORKERS_MAX]; // and where it starts
+    struct line_buffer* lines;
+};
+
+static void index_count(void* ctx, int part) {
+    struct index_job* job = ctx;
+    size_t newlines[INDEX_BATCH];
+    size_t pos = job->bounds[part];
+    size_t end = job->bounds[part + 1];
+    int count = 0;
+    size_t last = 0;
+
+    while (pos < end) {
+        size_t n = scan_newlines(job->text, end, &pos, newlines, INDEX_BATCH);
+        if (n > 0) last = newlines[n - 1] + 1;
+        count += n;
+    }
+
+    job->newlines[part] = count;
+    job->last[part] = last;
+}
+
+static void index_fill(void* ctx, int part) {
+    struct index_job* job = ctx;
+    size_t newlines[INDEX_BATCH];
+    size_t pos = job->bounds[part];
+    size_t end = job->bounds[part + 1];
+    struct line_buffer* line = &job->lines[job->first[part]];
+    size_t line_start = job->start[part];
+
+    while (pos < end) {
+        size_t n = scan_newlines(job->text, end, &pos, newlines, INDEX_BATCH);
+        for (size_t i = 0; i < n; i++) {
+            view_line(line++, job->text + line_start, newlines[i] - line_start);
+            line_start = newlines[i] + 1;
+        }
+    }
+}
+
+static int index_lines_parallel(struct file_buffer* fb, struct line_list* list, int parts) {
+    struct index_job* job = malloc(sizeof(struct index_job));
+    if (job == NULL) return -1;
+
+    size_t size = fb->text_size;
+    job->text = fb->text;
+    for (int i = 0; i <= parts; i++) job->bounds[i] = size / parts * i;
+    job->bounds[parts] = size;
+
+    workers_run(parts, index_count, job);
+
+    size_t count = 0;
+    size_t line_start = 0;
+    for (int i = 0; i < parts; i++) {
+        job->first[i] = count;
+        job->start[i] = line_start;
+        count += job->newlines[i];
+        if (job->last[i] > 0) line_start = job->last[i];
+    }
+
+    bool unterminated = fb->text[size - 1] != '\n';
+    if (count + unterminated > INT_MAX) {
+        free(job);
+        return -1;
+    }
+
+    list->count = count + unterminated;
+    list->cap = list->count;
+    list->lines = malloc(list->cap * sizeof(struct line_buffer));
+    if (list->lines == NULL) {
+        free(job);
+        return -1;
+    }
+    job->lines = list->lines;
+
+    workers_run(parts, index_fill, job);
+    if (unterminated) view_line(&list->lines[count], fb->text + line_start, size - line_start);
+
+    free(job);
+    return 0;
+}
+
+// one pass over the text, every line comes out as a view into it
+static int index_lines(struct file_buffer* fb, struct line_list* list) {
+    char* text = fb->text;
+    size_t size = fb->text_size;
+
+    int parts = workers_for(size, INDEX_PART_MIN);
+    if (parts > 1) return index_lines_parallel(fb, list, parts);
+
+    list->cap = size / 64 + 16;
+    list->count = 0;
+    list->lines = malloc(list->cap * sizeof(struct line_buffer));
+    if (list->lines == NULL) return -1;
+
+    size_t newlines[INDEX_BATCH];
+    size_t pos = 0;
+    size_t line_start = 0;
+
+    while (pos < size) {
+        size_t n = scan_newlines(text, size, &pos, newlines, INDEX_BATCH);
+
+        for (size_t i = 0; i < n; i++) {
+            if (add_line(list, text + line_start, newlines[i] - line_start) != 0) return -1;
+            line_start = newlines[i] + 1;
+        }
+    }
+
+    if (size == 0 || text[size - 1] != '\n') {
+        if (add_line(list, text + line_start, size - line_start) != 0) return -1;
+    }
+
+    return 0;
+}
+
+static int slab_slot_size(int len) {
+    return (len + SLAB_GAP + 7) & ~7;
+}
+
+// copies every line into one allocation so the text can go. each line keeps the slack of its slot as its gap
+static int build_slab(struct file_buffer* fb, struct line_list* list) {
+    size_t slab_size = 0;
+    for (int i = 0; i < list->count; i++) {
+        slab_size += slab_slot_size(list->lines[i].len);
+    }
+
+    fb->slab = malloc(slab_size);
+    if (fb->slab == NULL) return -1;
+    fb->held_bytes += slab_size; // slab lines are held as part of it, see account
+
+    char* slot = fb->slab;
+    for (int i = 0; i < list->count; i++) {
+        struct line_buffer* line = &list->lines[i];
+        int len = line->len;
+        int slot_size = slab_slot_size(len);
+
+        memcpy(slot, line->buf, len);
+
+        line->buf = slot;
+        line->len = slot_size;
+        line->gap_start = len;
+        line->gap_end = slot_size;
+        line->storage = LINE_SLAB;
+
+        slot += slot_size;
+    }
+
+    free_text(fb);
+    return 0;
+}
+
+static int lb_line_length(const struct line_buffer* line);
+
+// keeps live_bytes and held_bytes up to date. -1 before a line changes or goes away, 1 once it changed or came
+static void account(struct file_buffer* fb, const struct line_buffer* lb, int sign) {
+    size_t live = lb_line_length(lb);
+    size_t held = lb->storage == LINE_SLAB ? 0 : lb->len;
+
+    if (sign > 0) {
+        fb->live_bytes += live;
+        fb->held_bytes += held;
+    } else {
+        fb->live_bytes -= live;
+        fb->held_bytes -= held;
+    }
+}
+
+static size_t waste(struct file_buffer* fb) {
+    return fb->held_bytes - fb->live_bytes + (fb->pool.chunk_bytes - fb->pool.in_use);
+}
+
 int open_file_buffer(struct file_buffer* fb, const char* path) {
+    int64_t start = stats_now(); // only what it took on this thread, a paged file is indexed behind it
+    fb->slab = NULL;
+    fb->root = NULL;
+    fb->line_count = 0;
+    fb->finger.depth = 0;
+    fb->wrap_width = 0;
+    fb->rows_stale = false;
+    fb->undo = NULL;
+    for (int i = 0; i < COL_CACHE_MAX; i++) {
+        fb->col_cache[i] = (struct col_cache_entry) { .line = -1, .starts = NULL, .vcols = NULL, .cap = 0 };
+    }
+    fb->changes = 0;
+    fb->damage = (struct fb_damage) { .from = 0, .tail = 0, .old_count = 0 }; // all of it is new
+    fb->paged = NULL;
+    fb->text = NULL;
+    fb->text_size = 0;
+    fb->text_mapped = false;
+
+    lp_init(&fb->pool);
+    fb->live_bytes = 0;
+    fb->held_bytes = 0;
+    for (int i = 0; i < FB_HOT_LINES; i++) fb->hot[i] = -1;
+    fb->hot_next = 0;
+    fb->compact_at = -1;
+    fb->compact_waste = 0;
+    fb->shared = false;
+    fb->retired = NULL;
+    fb->retired_count = 0;
+    fb->retired_cap = 0;
+
     fb->fd = open(path, O_RDWR | O_CREAT, 0644);
     if (fb->fd < 0) return -1;
 
-    size_t size;
-    char* text = read_all(fb->fd, &size);
-    if (text == NULL) {
+    // resolve symlinks now so saving replaces the file they point at and not the link
+    fb->path = realpath(path, NULL);
+    if (fb->path == NULL) fb->path = strdup(path);
+
+    if (fb->path == NULL) {
         close(fb->fd);
         return -1;
     }
 
-    fb->line_count = 0;
-    for (size_t i = 0; i < size; i++) {
-        if (text[i] == '\n') fb->line_count++;
+    struct stat st;
+    if (fstat(fb->fd, &st) == 0 && S_ISREG(st.st_mode) && pg_wants(st.st_size)) {
+        if (pg_open(fb, st.st_size) == 0) {
+            stats_time(STATS_LOAD, start);
+            return 0;
+        }
+
+        free(fb->path);
+        close(fb->fd);
+        return -1;
     }
 
-    if (size == 0) fb->line_count = 1;
-    else if (size > 0 && text[size - 1] != '\n') fb->line_count++;
+    if (load_text(fb) != 0) {
+        free(fb->path);
+        close(fb->fd);
+        return -1;
+    }
 
-    fb->lines = malloc(fb->line_count * sizeof(struct line_buffer));
-    if (fb->lines == NULL) {
-        free(text);
+    struct line_list list = {0};
+    if (index_lines(fb, &list) != 0
+            || (fb->text_size <= SLAB_MAX_FILE && build_slab(fb, &list) != 0)
+            || lt_build(fb, list.lines, list.count) != 0) {
+        free(list.lines);
+        free(fb->slab);
+        free_text(fb);
+        free(fb->path);
         close(fb->fd);
         return -1;
     }
 
-    size_t line_start = 0;
-    size_t line_idx = 0;
-
-    for (size_t i = 0; i < size; i++) {
-        if (i == size || text[i] == '\n') {
-            struct line_buffer* line = &fb->lines[line_idx];
-            int len = i - line_start;
-            int cap = len + GAP_INIT;
-
-            line->len = cap;
-            line->buf = malloc(cap);
-
-            if (line->buf == NULL) {
-                for (size_t j = 0; j < line_idx; j++) free(fb->lines[j].buf);
-                free(fb->lines);
-                free(text);
-                close(fb->fd);
-                return -1;
-            }
+    for (int i = 0; i < list.count; i++) account(fb, &list.lines[i], 1);
+    fb->compact_waste = waste(fb); // the slab's slack is as packed as it gets
 
-            if (len > 0) {
-                memcpy(line->buf, text + line_start, line->len);
-            }
+    free(list.lines);
+    stats_time(STATS_LOAD, start);
+    return 0;
+}
 
-            memset(line->buf + len, 0, cap - len);
+static int free_line(struct line_buffer* line, void* ctx) {
+    struct file_buffer* fb = ctx;
+    if (line->storage == LINE_HEAP) lp_free(&fb->pool, line->buf, line->len);
+    return 0;
+}
+
+void close_file_buffer(struct file_buffer* fb) {
+    pg_close(fb);
+    for (int i = 0; i < COL_CACHE_MAX; i++) {
+        free(fb->col_cache[i].starts);
+        free(fb->col_cache[i].vcols);
+        fb->col_cache[i] = (struct col_cache_entry) { .line = -1, .starts = NULL, .vcols = NULL, .cap = 0 };
+    }
 
-            line->gap_start = len;
-            line->gap_end = cap;
+    if (fb->root != NULL) lt_for_each(fb, free_line, fb);
+    lt_free(fb);
+    lp_destroy(&fb->pool);
+    free(fb->retired);
+    free(fb->slab);
+    free_text(fb);
+    free(fb->path);
 
-            line_idx++;
-            line_start = i + 1;
+    if (fb->fd >= 0) {
+        close(fb->fd);
+    }
+
+    fb->slab = NULL;
+    fb->path = NULL;
+    fb->retired = NULL;
+    fb->retired_count = 0;
+    fb->retired_cap = 0;
+    fb->fd = -1;
+    fb->live_bytes = 0;
+    fb->held_bytes = 0;
+    fb->compact_at = -1;
+}
+
+struct save_batch {
+    int fd;
+    struct iovec iov[SAVE_IOV];
+    int count;
+};
+
+static int batch_flush(struct save_batch* batch) {
+    struct iovec* iov = batch->iov;
+    int count = batch->count;
+
+    while (count > 0) {
+        ssize_t n = writev(batch->fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+
+        // partial write, skip whatever made it out
+        while (count > 0 && (size_t) n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*) iov->iov_base + n;
+            iov->iov_len -= n;
         }
     }
 
-    free(text);
+    batch->count = 0;
     return 0;
 }
 
-void close_file_buffer(struct file_buffer* fb) {
-    for (int i = 0; i < fb->line_count; i++) free(fb->lines[i].buf);
-    free(fb->lines);
+// segments that continue where the previous one ended are merged, so runs of untouched views
+// (and their newlines in the text) go out as one big iovec
+static int batch_push(struct save_batch* batch, const char* data, size_t len) {
+    if (len == 0) return 0;
 
-    if (fb->fd >= 0) {
-        close(fb->fd);
+    if (batch->count > 0) {
+        struct iovec* last = &batch->iov[batch->count - 1];
+        if ((const char*) last->iov_base + last->iov_len == data) {
+            last->iov_len += len;
+            return 0;
+        }
     }
 
-    fb->lines = NULL;
-    fb->line_count = 0;
-    fb->fd = -1;
+    if (batch->count == SAVE_IOV && batch_flush(batch) != 0) return -1;
+
+    batch->iov[batch->count].iov_base = (void*) data;
+    batch->iov[batch->count].iov_len = len;
+    batch->count++;
+    return 0;
+}
+
+struct save_ctx {
+    struct save_batch batch;
+    char* text_end;
+};
+
+static int save_line(struct line_buffer* line, void* ctx) {
+    struct save_ctx* save = ctx;
+    char* end = line->buf + line->len;
+
+    if (batch_push(&save->batch, line->buf, line->gap_start) != 0) return -1;
+    if (batch_push(&save->batch, line->buf + line->gap_end, line->len - line->gap_end) != 0) return -1;
+
+    const char* newline = line->storage == LINE_VIEW && end < save->text_end ? end : "\n";
+    return batch_push(&save->batch, newline, 1);
+}
+
+static int write_lines(struct file_buffer* fb, int fd) {
+    struct save_ctx save;
+    save.batch.fd = fd;
+    save.batch.count = 0;
+    save.text_end = fb->text + fb->text_size;
+
+    if (lt_for_each(fb, save_line, &save) != 0) return -1;
+    return batch_flush(&save.batch);
+}
+
+static char* temp_path_for(const char* path) {
+    const char* slash = strrchr(path, '/');
+    int dir_len = slash != NULL ? slash - path + 1 : 0;
+    const char* name = path + dir_len;
+
+    size_t size = strlen(path) + 16;
+    char* tmp = malloc(size);
+    if (tmp == NULL) return NULL;
+
+    snprintf(tmp, size, "%.*s.%s.XXXXXX", dir_len, path, name);
+    return tmp;
+}
+
+static void sync_parent_dir(const char* path) {
+    const char* slash = strrchr(path, '/');
+    char dir[PATH_MAX];
+
+    if (slash == NULL) strcpy(dir, ".");
+    else if (slash == path) strcpy(dir, "/");
+    else snprintf(dir, sizeof(dir), "%.*s", (int) (slash - path), path);
+
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return;
+    fsync(fd);
+    close(fd);
 }
 
 int save_file_buffer(struct file_buffer* fb) {
-    if (fb->fd < 0 || fb->lines == NULL) return -1;
+    if (fb->fd < 0 || (fb->root == NULL && fb->paged == NULL)) return -1;
+    int64_t start = stats_now();
 
-    if (lseek(fb->fd, 0, SEEK_SET) < 0) return -1;
-    if (ftruncate(fb->fd, 0) < 0) return -1;
+    char* tmp_path = temp_path_for(fb->path);
+    if (tmp_path == NULL) return -1;
 
-    for (size_t i = 0; i < fb->line_count; i++) {
-        struct line_buffer* line = &fb->lines[i];
-        if (write(fb->fd, line->buf, line->gap_start) != (ssize_t) line->gap_start) return -1;
-        if (write(fb->fd, line->buf + line->gap_end, line->len - line->gap_end) != (ssize_t) line->len - line->gap_end) return -1;
-        if (write(fb->fd, "\n", 1) != 1) return -1;
+    int fd = mkstemp(tmp_path);
+    if (fd < 0) {
+        free(tmp_path);
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fb->fd, &st) == 0) {
+        fchmod(fd, st.st_mode & 07777);
+        fchown(fd, st.st_uid, st.st_gid); // only works if we're allowed to, not worth failing over
+    }
+
+    int written = fb->paged != NULL ? pg_write(fb, fd) : write_lines(fb, fd);
+    if (written != 0 || fsync(fd) != 0 || rename(tmp_path, fb->path) != 0) {
+        close(fd);
+        unlink(tmp_path);
+        free(tmp_path);
+        return -1;
     }
 
-    fsync(fb->fd);
+    sync_parent_dir(fb->path);
+    free(tmp_path);
+
+    // the old file is unlinked now but stays alive for as long as the mapping (if any) needs it.
+    // paged files keep reading it until they're closed, the overlays are relative to it
+    if (fb->paged == NULL) close(fb->fd);
+    fb->fd = fd;
+    stats_time(STATS_SAVE, start);
+    return 0;
+}
+
+static int snapshot_line(struct line_buffer* line, void* ctx) {
+    struct fb_snapshot* snap = ctx;
+    snap->lines[snap->count++] = *line;
     return 0;
 }
 
-static int lb_line_length(struct line_buffer* line);
+int fb_snapshot_take(struct file_buffer* fb, struct fb_snapshot* snap) {
+    if (fb->paged != NULL || fb->shared) return -1;
+
+    if (snap->cap < fb->line_count) {
+        struct line_buffer* tmp = realloc(snap->lines, fb->line_count * sizeof(struct line_buffer));
+        if (tmp == NULL) return -1;
+        snap->lines = tmp;
+        snap->cap = fb->line_count;
+    }
+
+    snap->count = 0;
+    snap->text_end = fb->text + fb->text_size;
+    lt_for_each(fb, snapshot_line, snap);
+    fb->shared = true;
+    return 0;
+}
+
+void fb_snapshot_release(struct file_buffer* fb, struct fb_snapshot* snap) {
+    for (int i = 0; i < fb->retired_count; i++) lp_free(&fb->pool, fb->retired[i].buf, fb->retired[i].size);
+    fb->retired_count = 0;
+    fb->shared = false;
+    snap->count = 0;
+}
+
+void fb_snapshot_free(struct fb_snapshot* snap) {
+    free(snap->lines);
+    snap->lines = NULL;
+    snap->count = 0;
+    snap->cap = 0;
+}
+
+int fb_snapshot_write(const struct fb_snapshot* snap, int fd) {
+    struct save_ctx save;
+    save.batch.fd = fd;
+    save.batch.count = 0;
+    save.text_end = (char*) snap->text_end;
+
+    for (int i = 0; i < snap->count; i++) {
+        if (save_line((struct line_buffer*) &snap->lines[i], &save) != 0) return -1;
+    }
+    return batch_flush(&save.batch);
+}
 
 static char lb_char_at(struct line_buffer* line, int col) {
     int len = lb_line_length(line);
@@ -148,26 +624,113 @@ static char lb_char_at(struct line_buffer* line, int col) {
     return line->buf[col + gap_size];
 }
 
+// paged files only have a line_buffer for lines that were edited, NULL means ask paged.c
+static struct line_buffer* line_get(struct file_buffer* fb, int line) {
+    return fb->paged != NULL ? pg_overlay(fb, line) : lt_get(fb, line);
+}
+
 char fb_char_at(struct file_buffer* fb, int line, int col) {
-    if (line < 0 || line >= fb->line_count) return 0; // should i do '\0' for errors instead? does it matter?
-    return lb_char_at(&fb->lines[line], col);
+    struct line_buffer* lb = line_get(fb, line);
+    if (lb == NULL && fb->paged != NULL) return pg_char_at(fb, line, col);
+    if (lb == NULL) return 0; // should i do '\0' for errors instead? does it matter?
+    return lb_char_at(lb, col);
 }
 
-static int lb_line_length(struct line_buffer* line) {
+static int lb_line_length(const struct line_buffer* line) {
     return line->gap_start + (line->len - line->gap_end);
 }
 
 int fb_line_length(struct file_buffer* fb, int line_n) {
-    if (line_n < 0 || line_n >= fb->line_count) return -1;
-    struct line_buffer* line = &fb->lines[line_n];
+    struct line_buffer* line = line_get(fb, line_n);
+    if (line == NULL && fb->paged != NULL) return pg_line_length(fb, line_n);
+    if (line == NULL) return -1;
     return lb_line_length(line);
 }
 
-static void lb_move_gap(struct line_buffer* line, int col) {
+// frees a line's buffer, or keeps it until the snapshot that may still be reading it is released
+static void retire(struct file_buffer* fb, char* buf, int size) {
+    if (!fb->shared) {
+        lp_free(&fb->pool, buf, size);
+        return;
+    }
+    if (buf == NULL) return;
+
+    if (fb->retired_count == fb->retired_cap) {
+        int new_cap = fb->retired_cap == 0 ? 64 : fb->retired_cap * 2;
+        struct retired_buf* tmp = realloc(fb->retired, new_cap * sizeof(struct retired_buf));
+        if (tmp == NULL) return; // leaked, which beats freeing it under the snapshot
+        fb->retired = tmp;
+        fb->retired_cap = new_cap;
+    }
+    fb->retired[fb->retired_count++] = (struct retired_buf) { .buf = buf, .size = size };
+}
+
+// moves the line into its own heap buffer with a gap of at least gap_size where the gap is now, whatever the
+// pool rounds up to goes to the gap too. views need this before anything writes to them, slab lines when
+// they outgrow their slot
+static int lb_regrow(struct file_buffer* fb, struct line_buffer* line, int gap_size) {
+    int after_len = line->len - line->gap_end;
+    int new_len = lp_size(line->gap_start + gap_size + after_len);
+    gap_size = new_len - line->gap_start - after_len;
+
+    char* new_buf = lp_alloc(&fb->pool, new_len);
+    if (new_buf == NULL) return -1; // OOM
+
+    if (line->gap_start > 0) memcpy(new_buf, line->buf, line->gap_start);
+    if (after_len > 0) {
+        memcpy(new_buf + line->gap_start + gap_size,
+               line->buf + line->gap_end,
+               after_len);
+    }
+
+    if (line->storage == LINE_HEAP) retire(fb, line->buf, line->len);
+    line->buf = new_buf;
+    line->gap_end = line->gap_start + gap_size;
+    line->len = new_len;
+    line->storage = LINE_HEAP;
+    return 0;
+}
+
+// a snapshot may be reading the line's buffer, it gets a copy with the same gap before anything writes to
+// it. views are never written to anyway
+static int lb_unshare(struct file_buffer* fb, struct line_buffer* line) {
+    if (!fb->shared || line->storage == LINE_VIEW) return 0;
+    return lb_regrow(fb, line, line->gap_end - line->gap_start);
+}
+
+static int lb_init(struct file_buffer* fb, struct line_buffer* line, const char* data, int len) {
+    int size = lp_size(len + GAP_INIT);
+    line->buf = lp_alloc(&fb->pool, size);
+    if (line->buf == NULL) return -1;
+
+    if (len > 0) memcpy(line->buf, data, len);
+    line->len = size;
+    line->gap_start = len;
+    line->gap_end = size;
+    line->storage = LINE_HEAP;
+    return 0;
+}
+
+static void lb_move_gap(struct file_buffer* fb, struct line_buffer* line, int col) {
     int len = lb_line_length(line);
     if (col < 0) col = 0;
     else if (col > len) col = len;
 
+    if (line->gap_start == line->gap_end) { // nothing to shuffle, and views can't be written anyway
+        line->gap_start = col;
+        line->gap_end = col;
+        return;
+    }
+
+    if (col == line->gap_start) return;
+
+    // a view with a gap (something was deleted) would have to be shuffled in place
+    if (line->storage == LINE_VIEW) {
+        if (lb_regrow(fb, line, line->gap_end - line->gap_start) != 0) return;
+    } else if (lb_unshare(fb, line) != 0) {
+        return;
+    }
+
     if (col < line->gap_start) {
         int amount = line->gap_start - col;
         memmove(line->buf + (line->gap_end - amount), line->buf + col, amount);
@@ -181,44 +744,126 @@ static void lb_move_gap(struct line_buffer* line, int col) {
     }
 }
 
-static void lb_set_cursor_pos(struct line_buffer* line, int col) {
+static void lb_set_cursor_pos(struct file_buffer* fb, struct line_buffer* line, int col) {
     int len = lb_line_length(line);
     if (col > len) col = len;
 
-    lb_move_gap(line, col);
+    lb_move_gap(fb, line, col);
 }
 
 void fb_set_cursor_pos(struct file_buffer* fb, int line, int col) {
     if (line < 0) line = 0;
      else if (line >= fb->line_count) line = fb->line_count - 1;
 
-    lb_set_cursor_pos(&fb->lines[line], col);
+    struct line_buffer* lb = line_get(fb, line);
+    if (lb == NULL && fb->paged != NULL) { // remembered for when the line gets an overlay
+        fb->paged->cursor_line = line;
+        fb->paged->cursor_col = col;
+        return;
+    }
+
+    account(fb, lb, -1); // a view can end up with a buffer of its own
+    lb_set_cursor_pos(fb, lb, col);
+    account(fb, lb, 1);
 }
 
-static void lb_insert_char(struct line_buffer* line, char c) {
-    if (line->gap_start >= line->gap_end) {
-        int gap_size = (line->len / 2) + 8;
-        char* new_buf = malloc(line->len + gap_size);
-        if (new_buf == NULL) return; // OOM
+// the line to change. a paged line gets copied into an overlay the first time
+static struct line_buffer* line_edit(struct file_buffer* fb, int line) {
+    if (fb->paged == NULL) return lt_get(fb, line);
 
-        memcpy(new_buf, line->buf, line->gap_start);
-        int after_len = line->len - line->gap_end;
-        memcpy(new_buf + line->gap_start + gap_size,
-               line->buf + line->gap_end,
-               after_len);
+    struct line_buffer* lb = pg_overlay(fb, line);
+    if (lb != NULL) return lb;
+
+    int len = pg_line_length(fb, line);
+    if (len < 0 || len > OVERLAY_MAX_LINE) return NULL;
+
+    int size = lp_size(len + GAP_INIT);
+    struct line_buffer fresh = {
+        .buf = lp_alloc(&fb->pool, size),
+        .len = size,
+        .gap_start = len,
+        .gap_end = size,
+        .storage = LINE_HEAP,
+    };
+    if (fresh.buf == NULL) return NULL;
 
-        free(line->buf);
-        line->buf = new_buf;
-        line->gap_end = line->gap_start + gap_size;
-        line->len += gap_size;
+    if (pg_read_line(fb, line, fresh.buf) != len || (lb = pg_add_overlay(fb, line, &fresh)) == NULL) {
+        lp_free(&fb->pool, fresh.buf, size);
+        return NULL;
+    }
+
+    if (fb->paged->cursor_line == line) lb_move_gap(fb, lb, fb->paged->cursor_col);
+    account(fb, lb, 1);
+    return lb;
+}
+
+// rows the line wraps into before an edit, for line_changed to tell how many it gained or lost
+static int rows_before_edit(struct file_buffer* fb, int line, const struct line_buffer* lb) {
+    if (fb->paged != NULL) return pg_line_rows(fb, line);
+    return fb->rows_stale ? 0 : lt_line_rows(fb, lb);
+}
+
+static void line_changed(struct file_buffer* fb, int line, int old_rows) {
+    if (fb->paged != NULL) pg_line_changed(fb, line, old_rows);
+    else lt_line_changed(fb, line, old_rows);
+}
+
+// lines [from, to) are different now, to counts lines as they are after the change. moved is whether
+// lines came or went, everything after from has another number then
+static void damage(struct file_buffer* fb, int from, int to, bool moved) {
+    fb->hot[fb->hot_next++ % FB_HOT_LINES] = from;
+    if (to - 1 > from) fb->hot[fb->hot_next++ % FB_HOT_LINES] = to - 1;
+
+    if (from < fb->damage.from) fb->damage.from = from;
+    if (fb->line_count - to < fb->damage.tail) fb->damage.tail = fb->line_count - to;
+
+    for (int i = 0; i < COL_CACHE_MAX; i++) {
+        int line = fb->col_cache[i].line;
+        if (line >= from && (moved || line < to)) fb->col_cache[i].line = -1;
+    }
+}
+
+static int lb_insert_char(struct file_buffer* fb, struct line_buffer* line, char c) {
+    // views get their own buffer on the first insert, slab lines once they outgrow their slot
+    if (line->storage == LINE_VIEW || line->gap_start >= line->gap_end) {
+        int gap_size = line->storage == LINE_HEAP ? (line->len / 2) + 8 : GAP_INIT;
+        if (lb_regrow(fb, line, gap_size) != 0) return -1;
+    } else if (lb_unshare(fb, line) != 0) {
+        return -1;
     }
 
     line->buf[line->gap_start++] = c;
+    return 0;
+}
+
+// makes room for len more bytes at the gap all at once and copies them in
+static int lb_insert_str(struct file_buffer* fb, struct line_buffer* line, const char* text, int len) {
+    if (line->storage == LINE_VIEW || line->gap_end - line->gap_start < len) {
+        int gap_size = len + (line->storage == LINE_HEAP ? (line->len / 2) + 8 : GAP_INIT);
+        if (lb_regrow(fb, line, gap_size) != 0) return -1;
+    } else if (lb_unshare(fb, line) != 0) {
+        return -1;
+    }
+
+    memcpy(line->buf + line->gap_start, text, len);
+    line->gap_start += len;
+    return 0;
 }
 
 void fb_insert_char(struct file_buffer* fb, int line, char c) {
-    if (line < 0 || line >= fb->line_count) return;
-    lb_insert_char(&fb->lines[line], c);
+    struct line_buffer* lb = line_edit(fb, line);
+    if (lb == NULL) return;
+
+    int old_rows = rows_before_edit(fb, line, lb);
+    account(fb, lb, -1);
+    int failed = lb_insert_char(fb, lb, c);
+    account(fb, lb, 1);
+    if (failed) return;
+    line_changed(fb, line, old_rows);
+
+    fb->changes++;
+    damage(fb, line, line + 1, false);
+    if (fb->undo != NULL) undo_record_insert(fb->undo, line, lb->gap_start - 1, c);
 }
 
 static void lb_delete_char(struct line_buffer* line) {
@@ -227,6 +872,574 @@ static void lb_delete_char(struct line_buffer* line) {
 }
 
 void fb_delete_char(struct file_buffer* fb, int line) {
-    if (line < 0 || line >= fb->line_count) return;
-    lb_delete_char(&fb->lines[line]);
+    struct line_buffer* lb = line_edit(fb, line);
+    if (lb == NULL || lb->gap_end >= lb->len) return;
+
+    fb->changes++;
+    damage(fb, line, line + 1, false);
+    if (fb->undo != NULL) undo_record_delete(fb->undo, line, lb->gap_start, lb->buf[lb->gap_end]);
+
+    int old_rows = rows_before_edit(fb, line, lb);
+    account(fb, lb, -1);
+    lb_delete_char(lb);
+    account(fb, lb, 1);
+    line_changed(fb, line, old_rows);
+}
+
+void fb_delete_chars(struct file_buffer* fb, int line, int count) {
+    struct line_buffer* lb = line_edit(fb, line);
+    if (lb == NULL || count <= 0) return;
+    if (count > lb->len - lb->gap_end) count = lb->len - lb->gap_end;
+    if (count == 0) return;
+
+    fb->changes++;
+    damage(fb, line, line + 1, false);
+    if (fb->undo != NULL) undo_record_delete_str(fb->undo, line, lb->gap_start, lb->buf + lb->gap_end, count);
+
+    int old_rows = rows_before_edit(fb, line, lb);
+    account(fb, lb, -1);
+    lb->gap_end += count;
+    account(fb, lb, 1);
+    line_changed(fb, line, old_rows);
+}
+
+int fb_split_line(struct file_buffer* fb, int line, int col) {
+    if (fb->paged != NULL) return -1; // paged lines are only ever edited in place
+
+    struct line_buffer* lb = lt_get(fb, line);
+    if (lb == NULL) return -1;
+
+    int old_rows = rows_before_edit(fb, line, lb);
+    account(fb, lb, -1);
+    lb_move_gap(fb, lb, col);
+    account(fb, lb, 1);
+
+    struct line_buffer tail;
+    int tail_len = lb->len - lb->gap_end;
+
+    if (lb->storage == LINE_VIEW) { // nothing ever writes to a view, so both can point at the same bytes
+        tail.buf = lb->buf + lb->gap_end;
+        tail.len = tail_len;
+        tail.gap_start = tail_len;
+        tail.gap_end = tail_len;
+        tail.storage = LINE_VIEW;
+    } else if (lb_init(fb, &tail, lb->buf + lb->gap_end, tail_len) != 0) {
+        return -1;
+    }
+
+    if (lt_insert(fb, line + 1, &tail) != 0) {
+        if (tail.storage == LINE_HEAP) lp_free(&fb->pool, tail.buf, tail.len);
+        return -1;
+    }
+    account(fb, &tail, 1);
+
+    // the insert may have moved it to another leaf
+    lb = lt_get(fb, line);
+    account(fb, lb, -1);
+    lb->gap_end = lb->len;
+    account(fb, lb, 1);
+    lt_line_changed(fb, line, old_rows);
+
+    fb->changes++;
+    damage(fb, line, line + 2, true);
+    if (fb->undo != NULL) undo_record_split(fb->undo, line, lb->gap_start);
+    return 0;
+}
+
+int fb_join_lines(struct file_buffer* fb, int line) {
+    if (fb->paged != NULL) return -1;
+    if (line < 0 || line + 1 >= fb->line_count) return -1;
+
+    struct line_buffer* lb = lt_get(fb, line);
+    struct line_buffer* next = lt_get(fb, line + 1); // both stay valid until the tree changes shape
+    int old_len = lb_line_length(lb);
+    int old_rows = rows_before_edit(fb, line, lb);
+    int next_len = lb_line_length(next);
+
+    account(fb, lb, -1);
+    lb_move_gap(fb, lb, old_len);
+    if (lb->storage == LINE_VIEW || lb->gap_end - lb->gap_start < next_len) {
+        int gap_size = next_len + (lb->storage == LINE_HEAP ? (lb->len / 2) + 8 : GAP_INIT);
+        if (lb_regrow(fb, lb, gap_size) != 0) {
+            account(fb, lb, 1);
+            return -1;
+        }
+    } else if (lb_unshare(fb, lb) != 0) {
+        account(fb, lb, 1);
+        return -1;
+    }
+
+    if (next_len > 0) {
+        int next_after = next->len - next->gap_end;
+        memcpy(lb->buf + lb->gap_start, next->buf, next->gap_start);
+        memcpy(lb->buf + lb->gap_start + next->gap_start, next->buf + next->gap_end, next_after);
+        lb->gap_start += next_len;
+        lt_line_changed(fb, line, old_rows);
+    }
+    account(fb, lb, 1);
+
+    struct line_buffer removed;
+    if (lt_remove(fb, line + 1, &removed) != 0) return -1;
+    account(fb, &removed, -1);
+    if (removed.storage == LINE_HEAP) retire(fb, removed.buf, removed.len);
+
+    fb->changes++;
+    damage(fb, line, line + 1, true);
+    if (fb->undo != NULL) undo_record_join(fb->undo, line, old_len);
+    return 0;
+}
+
+int fb_delete_lines(struct file_buffer* fb, int line, int count) {
+    if (fb->paged != NULL) return -1;
+    if (line < 0 || line >= fb->line_count || count <= 0) return -1;
+    if (count > fb->line_count - line) count = fb->line_count - line;
+
+    fb->changes++;
+    if (fb->undo != NULL) undo_record_delete_lines(fb->undo, fb, line, count, count == fb->line_count);
+
+    for (int i = 0; i < count; i++) {
+        struct line_buffer removed;
+        if (lt_remove(fb, line, &removed) != 0) return -1;
+        account(fb, &removed, -1);
+        if (removed.storage == LINE_HEAP) retire(fb, removed.buf, removed.len);
+    }
+
+    if (fb->line_count == 0) { // a file always has at least one line
+        struct line_buffer empty = { .buf = NULL, .len = 0, .gap_start = 0, .gap_end = 0, .storage = LINE_HEAP };
+        if (lt_insert(fb, 0, &empty) != 0) return -1;
+    }
+
+    damage(fb, line, line < fb->line_count ? line : fb->line_count, true); // the line now at line has a new neighbour
+    return 0;
+}
+
+int fb_insert_line(struct file_buffer* fb, int line, const char* text, int len) {
+    if (fb->paged != NULL) return -1;
+    if (line < 0 || line > fb->line_count) return -1;
+
+    struct line_buffer lb;
+    if (lb_init(fb, &lb, text, len) != 0) return -1;
+
+    if (lt_insert(fb, line, &lb) != 0) {
+        lp_free(&fb->pool, lb.buf, lb.len);
+        return -1;
+    }
+    account(fb, &lb, 1);
+
+    fb->changes++;
+    damage(fb, line, line + 1, true);
+    if (fb->undo != NULL) undo_record_insert_line(fb->undo, line, text, len);
+    return 0;
+}
+
+int fb_insert_str(struct file_buffer* fb, int line, const char* text, int len) {
+    if (len <= 0) return 0;
+
+    const char* nl = memchr(text, '\n', len);
+    if (nl != NULL && fb->paged != NULL) return -1;
+
+    struct line_buffer* lb = line_edit(fb, line);
+    if (lb == NULL) return -1;
+
+    int old_rows = rows_before_edit(fb, line, lb);
+    int col = lb->gap_start;
+
+    if (nl == NULL) {
+        account(fb, lb, -1);
+        int failed = lb_insert_str(fb, lb, text, len);
+        account(fb, lb, 1);
+        if (failed) return -1;
+        line_changed(fb, line, old_rows);
+
+        fb->changes++;
+        damage(fb, line, line + 1, false);
+        if (fb->undo != NULL) undo_record_insert_str(fb->undo, line, col, text, len);
+        return 0;
+    }
+
+    // the line ends after the first piece, what was after the gap goes behind the last piece. that one
+    // is built with its gap already in between, right where the cursor ends up
+    int first = nl - text;
+    const char* last_nl = text + len - 1;
+    while (*last_nl != '\n') last_nl--;
+
+    const char* last_text = last_nl + 1;
+    int last_len = text + len - last_text;
+    int tail_len = lb->len - lb->gap_end;
+
+    int size = lp_size(last_len + GAP_INIT + tail_len);
+    struct line_buffer last = {
+        .buf = lp_alloc(&fb->pool, size),
+        .len = size,
+        .gap_start = last_len,
+        .gap_end = size - tail_len,
+        .storage = LINE_HEAP,
+    };
+    if (last.buf == NULL) return -1;
+    if (last_len > 0) memcpy(last.buf, last_text, last_len);
+    if (tail_len > 0) memcpy(last.buf + last.gap_end, lb->buf + lb->gap_end, tail_len);
+
+    // the line only changes after the insert, which can recount the rows of the leaf it's in
+    if (lt_insert(fb, line + 1, &last) != 0) {
+        lp_free(&fb->pool, last.buf, last.len);
+        return -1;
+    }
+
+    lb = lt_get(fb, line); // the insert may have moved it to another leaf
+    account(fb, lb, -1);
+    if (first > 0 && lb_insert_str(fb, lb, text, first) != 0) {
+        account(fb, lb, 1);
+        struct line_buffer removed;
+        if (lt_remove(fb, line + 1, &removed) == 0) lp_free(&fb->pool, removed.buf, removed.len);
+        return -1;
+    }
+    lb->gap_end = lb->len;
+    account(fb, lb, 1);
+    account(fb, &last, 1);
+    lt_line_changed(fb, line, old_rows);
+
+    fb->changes++;
+    if (fb->undo != NULL) {
+        if (first > 0) undo_record_insert_str(fb->undo, line, col, text, first);
+        undo_record_split(fb->undo, line, col + first);
+        if (last_len > 0) undo_record_insert_str(fb->undo, line + 1, 0, last_text, last_len);
+    }
+
+    // and every line in between gets put in front of the last one
+    int added = 1;
+    const char* start = nl + 1;
+    while (start <= last_nl) {
+        const char* end = memchr(start, '\n', last_nl + 1 - start);
+        if (fb_insert_line(fb, line + added, start, end - start) != 0) break;
+        added++;
+        start = end + 1;
+    }
+
+    damage(fb, line, line + added + 1, true);
+    return added;
+}
+
+void fb_set_wrap_width(struct file_buffer* fb, int width) {
+    if (width < 1) width = 1;
+    if (width == fb->wrap_width) return;
+
+    fb->wrap_width = width;
+    if (fb->paged != NULL) pg_set_wrap_width(fb);
+    else lt_invalidate_rows(fb);
+}
+
+int fb_line_rows(struct file_buffer* fb, int line) {
+    if (fb->paged != NULL) return pg_line_rows(fb, line);
+
+    struct line_buffer* lb = lt_get(fb, line);
+    if (lb == NULL) return 0;
+    return lt_line_rows(fb, lb);
+}
+
+int fb_rows_before(struct file_buffer* fb, int line) {
+    if (fb->paged != NULL) return pg_rows_before(fb, line);
+    return lt_rows_before(fb, line);
+}
+
+int fb_total_rows(struct file_buffer* fb) {
+    if (fb->paged != NULL) return pg_total_rows(fb);
+    return lt_rows_before(fb, fb->line_count);
+}
+
+int fb_line_at_row(struct file_buffer* fb, int row, int* row_in_line) {
+    if (fb->paged != NULL) return pg_line_at_row(fb, row, row_in_line);
+    return lt_line_at_row(fb, row, row_in_line);
+}
+
+static struct col_cache_entry* columns(struct file_buffer* fb, int line) {
+    if (line < 0 || line >= fb->line_count) return NULL;
+
+    int wrap = fb->wrap_width > 0 ? fb->wrap_width : 1;
+    struct col_cache_entry* e = &fb->col_cache[line % COL_CACHE_MAX];
+    if (e->line == line && e->wrap == wrap) return e;
+
+    const char* a;
+    const char* b = NULL;
+    int a_len;
+    int b_len = 0;
+    char* copy = NULL;
+
+    struct line_buffer* lb = line_get(fb, line);
+    if (lb != NULL) {
+        a = lb->buf;
+        a_len = lb->gap_start;
+        b = lb->buf + lb->gap_end;
+        b_len = lb->len - lb->gap_end;
+    } else { // a paged line nobody edited
+        a_len = fb_line_length(fb, line);
+        copy = malloc(a_len > 0 ? a_len : 1);
+        if (copy == NULL || pg_read_line(fb, line, copy) != a_len) {
+            free(copy);
+            return NULL;
+        }
+        a = copy;
+    }
+
+    e->line = -1;
+    int plain = a_len > 0 ? (int) scan_plain(a, a_len) : 0;
+    if (plain == a_len && b_len > 0) plain += (int) scan_plain(b, b_len);
+
+    if (plain == a_len + b_len) {
+        e->count = -1;
+        e->width = plain;
+    } else {
+        int count = utf8_layout(a, a_len, b, b_len, wrap, NULL, NULL, &e->width);
+        if (count + 1 > e->cap) {
+            int* starts = realloc(e->starts, (count + 1) * sizeof(int));
+            if (starts != NULL) e->starts = starts;
+            int* vcols = realloc(e->vcols, (count + 1) * sizeof(int));
+            if (vcols != NULL) e->vcols = vcols;
+
+            if (starts == NULL || vcols == NULL) {
+                free(copy);
+                return NULL;
+            }
+            e->cap = count + 1;
+        }
+
+        e->count = utf8_layout(a, a_len, b, b_len, wrap, e->starts, e->vcols, &e->width);
+    }
+
+    free(copy);
+    e->line = line;
+    e->wrap = wrap;
+    return e;
+}
+
+static int char_containing(struct col_cache_entry* e, int col) { // last k with starts[k] <= col
+    int lo = 0;
+    int hi = e->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (e->starts[mid] <= col) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
+}
+
+static bool zero_width(struct col_cache_entry* e, int k) {
+    return k < e->count && e->vcols[k + 1] == e->vcols[k];
+}
+
+int fb_line_width(struct file_buffer* fb, int line) {
+    struct col_cache_entry* e = columns(fb, line);
+    return e != NULL ? e->width : 0;
+}
+
+int fb_col_to_vcol(struct file_buffer* fb, int line, int col) {
+    struct col_cache_entry* e = columns(fb, line);
+    if (e == NULL || col <= 0) return 0;
+    if (e->count < 0) return col < e->width ? col : e->width;
+    return e->vcols[char_containing(e, col)];
+}
+
+int fb_vcol_to_col(struct file_buffer* fb, int line, int vcol) {
+    struct col_cache_entry* e = columns(fb, line);
+    if (e == NULL || vcol <= 0) return 0;
+    if (e->count < 0) return vcol < e->width ? vcol : e->width;
+    if (vcol >= e->width) return e->starts[e->count];
+
+    // the first char that ends after vcol
+    int lo = 0;
+    int hi = e->count - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (e->vcols[mid + 1] > vcol) hi = mid;
+        else lo = mid + 1;
+    }
+    return e->starts[lo];
+}
+
+int fb_next_char(struct file_buffer* fb, int line, int col) {
+    struct col_cache_entry* e = columns(fb, line);
+    if (e == NULL) return 0;
+    if (e->count < 0) return col < e->width ? col + 1 : e->width;
+
+    int k = char_containing(e, col);
+    if (k < e->count) k++;
+    while (zero_width(e, k)) k++;
+    return e->starts[k];
+}
+
+int fb_prev_char(struct file_buffer* fb, int line, int col) {
+    struct col_cache_entry* e = columns(fb, line);
+    if (e == NULL || col <= 0) return 0;
+    if (e->count < 0) return col <= e->width ? col - 1 : e->width;
+
+    int k = char_containing(e, col);
+    if (e->starts[k] == col && k > 0) k--; // col is where a char starts, go to the one before it
+    while (k > 0 && zero_width(e, k)) k--;
+    return e->starts[k];
+}
+
+// every match lying entirely inside columns [lo, hi) of the line a + b, first or last one depending on backward.
+// the two halves get searched as they are, only the few bytes around the gap get copied together
+static int find_in_halves(const char* a, int a_len, const char* b, int b_len, const char* needle, int len,
+                          int lo, int hi, bool backward) {
+    char joined[2 * FB_FIND_MAX];
+    int join_start = lo > a_len - len + 1 ? lo : a_len - len + 1;
+    if (join_start < 0) join_start = 0;
+    int join_end = hi - a_len < len - 1 ? hi - a_len : len - 1;
+    if (join_end > b_len) join_end = b_len;
+
+    for (int part = 0; part < 3; part++) {
+        int which = backward ? 2 - part : part; // a, the bytes around the gap, b
+        const char* text;
+        int base; // column of text[0]
+        int size;
+
+        if (which == 0) {
+            text = a + lo;
+            base = lo;
+            size = (hi < a_len ? hi : a_len) - lo;
+        } else if (which == 1) {
+            if (join_start >= a_len || join_end <= 0) continue;
+            memcpy(joined, a + join_start, a_len - join_start);
+            memcpy(joined + a_len - join_start, b, join_end);
+            text = joined;
+            base = join_start;
+            size = a_len - join_start + join_end;
+        } else {
+            base = lo > a_len ? lo : a_len;
+            size = hi - base;
+            if (size < len) continue;
+            text = b + (base - a_len);
+        }
+
+        if (size < len) continue;
+
+        const char* hit = backward ? scan_find_last(text, size, needle, len) : scan_find(text, size, needle, len);
+        if (hit != NULL) return hit - text + base;
+    }
+
+    return -1;
+}
+
+int fb_find(struct file_buffer* fb, int line, const char* needle, int len, int from, bool backward) {
+    if (len <= 0 || len > FB_FIND_MAX) return -1;
+
+    int line_len = fb_line_length(fb, line);
+    if (line_len < len) return -1;
+
+    int lo = 0;
+    int hi = line_len;
+    if (!backward) lo = from < 0 ? 0 : from;
+    else if (from <= line_len - len) hi = from <= 0 ? 0 : from - 1 + len;
+    if (hi - lo < len) return -1;
+
+    struct line_buffer* lb = line_get(fb, line);
+    if (lb != NULL) {
+        return find_in_halves(lb->buf, lb->gap_start, lb->buf + lb->gap_end, lb->len - lb->gap_end,
+                              needle, len, lo, hi, backward);
+    }
+
+    // a paged line nobody has edited is spread over pages, get it in one piece
+    char* copy = malloc(line_len);
+    if (copy == NULL || pg_read_line(fb, line, copy) != line_len) {
+        free(copy);
+        return -1;
+    }
+
+    int col = find_in_halves(copy, line_len, NULL, 0, needle, len, lo, hi, backward);
+    free(copy);
+    return col;
+}
+
+int fb_index_fd(struct file_buffer* fb) {
+    return fb->paged != NULL ? pg_index_fd(fb) : -1;
+}
+
+void fb_index_progress(struct file_buffer* fb) {
+    if (fb->paged == NULL) return;
+
+    int old_count = fb->line_count;
+    pg_index_progress(fb);
+    if (fb->line_count != old_count) damage(fb, old_count > 0 ? old_count - 1 : 0, fb->line_count, false); // the last line may have been cut short
+}
+
+int fb_read_line(struct file_buffer* fb, int line, char* out) {
+    struct line_buffer* lb = line_get(fb, line);
+    if (lb == NULL) return fb->paged != NULL ? pg_read_line(fb, line, out) : -1;
+
+    int after = lb->len - lb->gap_end;
+    if (lb->gap_start > 0) memcpy(out, lb->buf, lb->gap_start);
+    if (after > 0) memcpy(out + lb->gap_start, lb->buf + lb->gap_end, after);
+    return lb->gap_start + after;
+}
+
+struct fb_damage fb_take_damage(struct file_buffer* fb) {
+    struct fb_damage d = fb->damage;
+    if (d.from > fb->line_count) d.from = fb->line_count;
+    if (d.tail > fb->line_count) d.tail = fb->line_count;
+    if (d.tail > d.old_count) d.tail = d.old_count;
+
+    fb->damage = (struct fb_damage) { .from = INT_MAX, .tail = INT_MAX, .old_count = fb->line_count };
+    return d;
+}
+
+struct fb_memory fb_memory(struct file_buffer* fb) {
+    return (struct fb_memory) {
+        .live = fb->live_bytes,
+        .slack = fb->held_bytes - fb->live_bytes,
+        .pooled = fb->pool.chunk_bytes - fb->pool.in_use,
+    };
+}
+
+static bool hot(struct file_buffer* fb, int line) {
+    for (int i = 0; i < FB_HOT_LINES; i++) {
+        if (fb->hot[i] == line) return true;
+    }
+    return false;
+}
+
+// moves the line into the smallest buffer that holds it, the gap stays where it is with whatever that
+// rounds up to. nothing about the text changes, so neither does anything that depends on it
+static void lb_pack(struct file_buffer* fb, struct line_buffer* line) {
+    int len = lb_line_length(line);
+    if (len > 0) {
+        lb_regrow(fb, line, 0); // no room is no harm, it stays as it was
+        return;
+    }
+
+    retire(fb, line->buf, line->len);
+    *line = (struct line_buffer) { .buf = NULL, .len = 0, .gap_start = 0, .gap_end = 0, .storage = LINE_HEAP };
+}
+
+bool fb_compact_pending(struct file_buffer* fb) {
+    if (fb->paged != NULL) return false; // the overlays are all there is, and they're few
+    if (fb->shared) return false; // it would only copy lines the snapshot holds on to
+    if (fb->compact_at >= 0) return true;
+
+    size_t threshold = fb->live_bytes / 16 > COMPACT_MIN_WASTE ? fb->live_bytes / 16 : COMPACT_MIN_WASTE;
+    return waste(fb) > fb->compact_waste + threshold;
+}
+
+bool fb_compact(struct file_buffer* fb, int budget) {
+    if (!fb_compact_pending(fb)) return false;
+    if (fb->compact_at < 0) fb->compact_at = 0;
+
+    for (; budget > 0 && fb->compact_at < fb->line_count; budget--) {
+        int line = fb->compact_at++;
+        if (hot(fb, line)) continue;
+
+        struct line_buffer* lb = lt_get(fb, line);
+        int len = lb_line_length(lb);
+        if (lb->storage != LINE_HEAP || lb->len <= (len > 0 ? lp_size(len) : 0)) continue;
+
+        account(fb, lb, -1);
+        lb_pack(fb, lb);
+        account(fb, lb, 1);
+    }
+
+    if (fb->compact_at < fb->line_count) return true;
+
+    lp_trim(&fb->pool);
+    fb->compact_at = -1;
+    fb->compact_waste = waste(fb);
+    return false;
 }
@@ -0,0 +1,171 @@
+// Copyright 2025 JesusTouchMe
+
+#include "highlight.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const struct hl_lexer* const g_lexers[] = {
+    &hl_lexer_c,
+};
+
+const struct hl_lexer* hl_lexer_for(const char* path) {
+    const char* dot = strrchr(path, '.');
+    const char* slash = strrchr(path, '/');
+    if (dot == NULL || (slash != NULL && dot < slash)) return NULL;
+
+    for (size_t i = 0; i < sizeof(g_lexers) / sizeof(g_lexers[0]); i++) {
+        for (const char* const* ext = g_lexers[i]->extensions; *ext != NULL; ext++) {
+            if (strcmp(dot, *ext) == 0) return g_lexers[i];
+        }
+    }
+
+    return NULL;
+}
+
+void hl_init(struct highlight* hl, const struct hl_lexer* lexer) {
+    hl->lexer = lexer;
+    hl->states = NULL;
+    hl->count = 0;
+    hl->cap = 0;
+    hl->valid = 0;
+    hl->converge = 0;
+    hl->known = 0;
+    hl->text = NULL;
+    hl->classes = NULL;
+    hl->text_cap = 0;
+}
+
+void hl_free(struct highlight* hl) {
+    free(hl->states);
+    free(hl->text);
+    free(hl->classes);
+    hl_init(hl, hl->lexer);
+}
+
+int hl_update(struct highlight* hl, const struct fb_damage* damage, int line_count) {
+    if (hl->lexer == NULL) return 0;
+
+    int old_count = hl->count;
+    if (damage->from >= line_count && line_count == old_count) return 0;
+
+    if (line_count > hl->cap) {
+        int new_cap = hl->cap == 0 ? 1024 : hl->cap;
+        while (new_cap < line_count) new_cap *= 2;
+
+        uint8_t* tmp = realloc(hl->states, new_cap);
+        if (tmp == NULL) {
+            free(hl->states);
+            hl->states = NULL;
+            hl->cap = 0;
+            hl->count = 0;
+            hl->valid = hl->converge = hl->known = 0;
+            return -1;
+        }
+
+        hl->states = tmp;
+        hl->cap = new_cap;
+    }
+
+    int tail = damage->tail < old_count ? damage->tail : old_count;
+    int delta = line_count - old_count;
+    int tail_old = old_count - tail; // where the untouched lines at the end started before
+    int tail_new = line_count - tail;
+
+    memmove(hl->states + tail_new, hl->states + tail_old, tail);
+
+    // whatever was known about the untouched lines moves along with them. states from valid on were worked out
+    // from whatever the line in front ended in at the time, which lexing up to valid may have changed since.
+    // so the window starts at valid, or later if there's garbage in between, or at 0 if it's all right
+    bool garbage = hl->converge > hl->valid && hl->converge < hl->known;
+    int converge = garbage ? hl->converge : hl->known > hl->valid ? hl->valid : 0;
+    converge = converge >= tail_old ? converge + delta : tail_new;
+    int known = hl->known > tail_old ? hl->known + delta : 0;
+
+    if (damage->from < hl->valid) hl->valid = damage->from;
+    hl->converge = converge;
+    hl->known = known > hl->valid ? known : hl->valid;
+    hl->count = line_count;
+    return 0;
+}
+
+static int lex_line(struct highlight* hl, struct file_buffer* fb, int line, bool classes) {
+    int len = fb_line_length(fb, line);
+    if (len < 0) return -1;
+
+    if (len > hl->text_cap) {
+        int new_cap = hl->text_cap == 0 ? 256 : hl->text_cap;
+        while (new_cap < len) new_cap *= 2;
+
+        char* text = realloc(hl->text, new_cap);
+        if (text == NULL) return -1;
+        hl->text = text;
+
+        uint8_t* tmp = realloc(hl->classes, new_cap);
+        if (tmp == NULL) return -1;
+        hl->classes = tmp;
+        hl->text_cap = new_cap;
+    }
+
+    if (fb_read_line(fb, line, hl->text) != len) return -1;
+
+    uint8_t state = line > 0 ? hl->states[line - 1] : 0;
+    state = hl->lexer->lex(state, hl->text, len, classes ? hl->classes : NULL);
+
+    if (line != hl->valid) return 0;
+
+    if (line >= hl->converge && line < hl->known && hl->states[line] == state) {
+        hl->valid = hl->known; // ends like before, so does everything it was known for after it
+        return 0;
+    }
+
+    hl->states[line] = state;
+    hl->valid = line + 1;
+    if (hl->known < hl->valid) hl->known = hl->valid;
+    return 0;
+}
+
+const uint8_t* hl_line(struct highlight* hl, struct file_buffer* fb, int line) {
+    if (hl->lexer == NULL || line < 0 || line >= hl->count) return NULL;
+
+    while (hl->valid < line) {
+        if (lex_line(hl, fb, hl->valid, false) != 0) return NULL;
+    }
+
+    if (lex_line(hl, fb, line, true) != 0) return NULL;
+    return hl->classes;
+}
+
+int hl_changed_until(struct highlight* hl, struct file_buffer* fb, int limit) {
+    if (hl->lexer == NULL) return 0;
+    if (limit > hl->count) limit = hl->count;
+    if (hl->valid >= limit) return 0;
+
+    while (hl->valid < limit) {
+        int line = hl->valid;
+        if (lex_line(hl, fb, line, false) != 0) return limit;
+        if (hl->valid != line + 1) return line + 1; // ended like before, the lines after start the same way
+    }
+    return limit;
+}
+
+struct color hl_color(enum hl_class class) {
+    switch (class) {
+        case HL_KEYWORD:
+            return (struct color) { 198, 120, 221 };
+        case HL_TYPE:
+            return (struct color) { 229, 192, 123 };
+        case HL_STRING:
+            return (struct color) { 152, 195, 121 };
+        case HL_NUMBER:
+            return (struct color) { 209, 154, 102 };
+        case HL_COMMENT:
+            return (struct color) { 127, 132, 142 };
+        case HL_PREPROC:
+            return (struct color) { 97, 175, 239 };
+        case HL_NORMAL:
+        case HL_CLASS_COUNT:
+            break;
+    }
+    return (struct color) { 220, 223, 228 };
+}
@@ -0,0 +1,233 @@
+// Copyright 2025 JesusTouchMe
+
+#include "keys.h"
+#include "scan.h"
+#include "terminal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define RING_MASK (KEYS_RING - 1)
+
+// what a sequence can turn out to be besides a key
+#define SEQ_IGNORED (-1) // a real sequence, just not one anything here cares about
+#define SEQ_PASTE (-2) // the start of a bracketed paste
+
+#define PASTE_INIT 65536
+
+void keys_init(struct key_decoder* kd) {
+    kd->head = 0;
+    kd->tail = 0;
+    kd->pending_since = -1;
+    kd->pasting = false;
+    kd->paste_heard = 0;
+    kd->paste = NULL;
+    kd->paste_len = 0;
+    kd->paste_cap = 0;
+}
+
+void keys_free(struct key_decoder* kd) {
+    free(kd->paste);
+    keys_init(kd);
+}
+
+static int buffered(const struct key_decoder* kd) {
+    return (int) (kd->tail - kd->head);
+}
+
+int keys_room(const struct key_decoder* kd) {
+    return KEYS_RING - buffered(kd);
+}
+
+void keys_feed(struct key_decoder* kd, const char* data, int len) {
+    int at = kd->tail & RING_MASK;
+    int first = len < KEYS_RING - at ? len : KEYS_RING - at;
+    memcpy(kd->ring + at, data, first);
+    memcpy(kd->ring, data + first, len - first);
+    kd->tail += len;
+}
+
+static unsigned char peek(const struct key_decoder* kd, int i) {
+    return kd->ring[(kd->head + i) & RING_MASK];
+}
+
+static int csi_key(int param, unsigned char final) {
+    switch (final) {
+        case 'A': return KEY_UP;
+        case 'B': return KEY_DOWN;
+        case 'C': return KEY_RIGHT;
+        case 'D': return KEY_LEFT;
+        case 'H': return KEY_HOME;
+        case 'F': return KEY_END;
+        case '~': break;
+        default: return SEQ_IGNORED;
+    }
+
+    switch (param) {
+        case 1:
+        case 7: return KEY_HOME;
+        case 3: return KEY_DELETE;
+        case 4:
+        case 8: return KEY_END;
+        case 5: return KEY_PAGE_UP;
+        case 6: return KEY_PAGE_DOWN;
+        case 200: return SEQ_PASTE;
+        default: return SEQ_IGNORED;
+    }
+}
+
+// the escape sequence at head, avail bytes of it buffered. returns how long it is and what it means
+// in *type, or 0 if it hasn't all arrived yet
+static int parse_sequence(const struct key_decoder* kd, int avail, int* type) {
+    if (avail < 2) return 0;
+
+    unsigned char kind = peek(kd, 1);
+    if (kind == 'O') { // ss3, what some terminals send for arrows, home and end
+        if (avail < 3) return 0;
+        *type = csi_key(0, peek(kd, 2));
+        return 3;
+    }
+
+    if (kind != '[') { // escape and then something typed right after it
+        *type = KEY_ESCAPE;
+        return 1;
+    }
+
+    int param = 0; // only the first one matters for any key here
+    bool first = true;
+    for (int i = 2; i < avail; i++) {
+        if (i >= KEYS_SEQ_MAX) break;
+
+        unsigned char c = peek(kd, i);
+        if (c >= '0' && c <= '9' && first) {
+            param = param * 10 + (c - '0');
+        } else if (c >= 0x20 && c <= 0x3F) {
+            if (c == ';') first = false;
+        } else if (c >= 0x40 && c <= 0x7E) {
+            *type = csi_key(param, c);
+            return i + 1;
+        } else { // not a sequence after all
+            *type = KEY_ESCAPE;
+            return 1;
+        }
+    }
+
+    if (avail < KEYS_SEQ_MAX) return 0;
+    *type = KEY_ESCAPE;
+    return 1;
+}
+
+static bool paste_done(struct key_decoder* kd, struct key* key, int len) {
+    kd->pasting = false;
+
+    key->type = KEY_PASTE;
+    key->text = kd->paste;
+    key->len = len;
+    return true;
+}
+
+// moves everything buffered over into the paste until the end marker shows up. if it goes quiet for long
+// enough without one (the terminal lost it, or the start marker was never a paste) that's the whole paste
+static bool paste_next(struct key_decoder* kd, struct key* key, int64_t now) {
+    int n = buffered(kd);
+    if (n == 0) {
+        if (now - kd->paste_heard < KEYS_PASTE_TIMEOUT) return false;
+        return paste_done(kd, key, kd->paste_len);
+    }
+    kd->paste_heard = now;
+
+    if (kd->paste_len + n > kd->paste_cap) {
+        int new_cap = kd->paste_cap;
+        while (new_cap < kd->paste_len + n) new_cap *= 2;
+
+        char* tmp = realloc(kd->paste, new_cap);
+        if (tmp == NULL) { // out of memory, keep looking for the end but let go of the paste itself
+            int keep = kd->paste_len < TERM_PASTE_MARKER_LEN ? kd->paste_len : TERM_PASTE_MARKER_LEN - 1;
+            memmove(kd->paste, kd->paste + kd->paste_len - keep, keep);
+            kd->paste_len = keep;
+            if (n > kd->paste_cap - keep) n = kd->paste_cap - keep;
+        } else {
+            kd->paste = tmp;
+            kd->paste_cap = new_cap;
+        }
+    }
+
+    // the end marker can be split over two reads, so look a little before what just came in too
+    int from = kd->paste_len > TERM_PASTE_MARKER_LEN ? kd->paste_len - TERM_PASTE_MARKER_LEN : 0;
+    for (int i = 0; i < n; i++) kd->paste[kd->paste_len++] = peek(kd, i);
+    kd->head += n;
+
+    const char* end = scan_find(kd->paste + from, kd->paste_len - from, TERM_PASTE_END, TERM_PASTE_MARKER_LEN);
+    if (end == NULL) return false;
+
+    // whatever came after the marker is still in the ring, it was only skipped
+    int len = end - kd->paste;
+    kd->head -= kd->paste_len - (len + TERM_PASTE_MARKER_LEN);
+    return paste_done(kd, key, len);
+}
+
+bool keys_next(struct key_decoder* kd, struct key* key, int64_t now) {
+    while (1) {
+        if (kd->pasting) return paste_next(kd, key, now);
+
+        int avail = buffered(kd);
+        if (avail == 0) {
+            kd->pending_since = -1;
+            return false;
+        }
+
+        unsigned char c = peek(kd, 0);
+        if (c != 0x1B) {
+            kd->pending_since = -1;
+            kd->head++;
+            key->type = KEY_CHAR;
+            key->c = (char) c;
+            return true;
+        }
+
+        int type;
+        int len = parse_sequence(kd, avail, &type);
+        if (len == 0) {
+            if (kd->pending_since < 0) kd->pending_since = now;
+            if (now - kd->pending_since < KEYS_ESCAPE_TIMEOUT) return false;
+
+            // nothing else came, it was typed as it is
+            type = KEY_ESCAPE;
+            len = 1;
+        }
+
+        kd->pending_since = -1;
+        kd->head += len;
+
+        if (type == SEQ_PASTE) {
+            // with no room at all it just comes in as if it were typed, like it would without bracketed paste
+            if (kd->paste == NULL && (kd->paste = malloc(PASTE_INIT)) != NULL) kd->paste_cap = PASTE_INIT;
+            kd->pasting = kd->paste != NULL;
+            kd->paste_heard = now;
+            kd->paste_len = 0;
+        } else if (type != SEQ_IGNORED) {
+            key->type = type;
+            return true;
+        }
+    }
+}
+
+int keys_timeout(const struct key_decoder* kd, int64_t now) {
+    int64_t left;
+    if (kd->pasting) left = kd->paste_heard + KEYS_PASTE_TIMEOUT - now;
+    else if (kd->pending_since >= 0) left = kd->pending_since + KEYS_ESCAPE_TIMEOUT - now;
+    else return -1;
+
+    return left > 0 ? (int) left : 0;
+}
+
+bool keys_pasting(const struct key_decoder* kd) {
+    return kd->pasting;
+}
+
+int64_t keys_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
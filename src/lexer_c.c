@@ -0,0 +1,162 @@
+// Copyright 2025 JesusTouchMe
+
+#include "highlight.h"
+
+#include <string.h>
+
+// c and anything that looks close enough to it. only block comments and strings continued with a
+// backslash carry over into the next line
+
+enum {
+    STATE_CODE,
+    STATE_COMMENT,
+    STATE_STRING,
+};
+
+static const char* const g_extensions[] = { ".c", ".h", NULL };
+
+static const char* const g_keywords[] = {
+    "auto", "break", "case", "const", "continue", "default", "do", "else", "enum", "extern", "for", "goto",
+    "if", "inline", "register", "restrict", "return", "sizeof", "static", "struct", "switch", "typedef",
+    "union", "volatile", "while", "_Alignas", "_Alignof", "_Atomic", "_Generic", "_Noreturn",
+    "_Static_assert", "_Thread_local", "true", "false", "NULL", NULL,
+};
+
+static const char* const g_types[] = {
+    "bool", "char", "double", "float", "int", "long", "short", "signed", "unsigned", "void", "_Bool",
+    "_Complex", "FILE", NULL,
+};
+
+static void fill(uint8_t* classes, int from, int to, enum hl_class class) {
+    if (classes != NULL && to > from) memset(classes + from, class, to - from);
+}
+
+static bool is_ident(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool word_in(const char* word, int len, const char* const* list) {
+    for (; *list != NULL; list++) {
+        if ((int) strlen(*list) == len && memcmp(*list, word, len) == 0) return true;
+    }
+    return false;
+}
+
+// i is just past the opening quote. returns just past the closing one, or len if the line ends first
+static int skip_quoted(const char* text, int len, int i, char quote) {
+    while (i < len) {
+        if (text[i] == '\\') i += 2;
+        else if (text[i++] == quote) return i;
+    }
+    return len;
+}
+
+// whether a string that ran to the end of the line goes on in the next one
+static bool continues(const char* text, int len, int start) {
+    int backslashes = 0;
+    for (int i = len - 1; i >= start && text[i] == '\\'; i--) backslashes++;
+    return backslashes % 2 == 1;
+}
+
+static int comment_end(const char* text, int len, int i) {
+    for (; i + 1 < len; i++) {
+        if (text[i] == '*' && text[i + 1] == '/') return i + 2;
+    }
+    return -1;
+}
+
+static uint8_t lex(uint8_t state, const char* text, int len, uint8_t* classes) {
+    fill(classes, 0, len, HL_NORMAL);
+
+    int i = 0;
+    if (state == STATE_COMMENT) {
+        i = comment_end(text, len, 0);
+        if (i < 0) {
+            fill(classes, 0, len, HL_COMMENT);
+            return STATE_COMMENT;
+        }
+        fill(classes, 0, i, HL_COMMENT);
+    } else if (state == STATE_STRING) {
+        i = skip_quoted(text, len, 0, '"');
+        fill(classes, 0, i, HL_STRING);
+        if (i == len && continues(text, len, 0)) return STATE_STRING;
+    }
+
+    bool line_start = state == STATE_CODE;
+
+    while (i < len) {
+        char c = text[i];
+        int start = i;
+
+        if (c == ' ' || c == '\t') {
+            i++;
+            continue;
+        }
+
+        if (c == '#' && line_start) { // the directive, and the file name if it's an include
+            i++;
+            while (i < len && (text[i] == ' ' || text[i] == '\t')) i++;
+            int word = i;
+            while (i < len && is_ident(text[i])) i++;
+            fill(classes, start, i, HL_PREPROC);
+
+            if (i - word == 7 && memcmp(text + word, "include", 7) == 0) {
+                while (i < len && (text[i] == ' ' || text[i] == '\t')) i++;
+                if (i < len && text[i] == '<') {
+                    int open = i;
+                    while (i < len && text[i] != '>') i++;
+                    if (i < len) i++;
+                    fill(classes, open, i, HL_STRING);
+                }
+            }
+        } else if (c == '/' && i + 1 < len && text[i + 1] == '/') {
+            fill(classes, i, len, HL_COMMENT);
+            return STATE_CODE;
+        } else if (c == '/' && i + 1 < len && text[i + 1] == '*') {
+            i = comment_end(text, len, i + 2);
+            if (i < 0) {
+                fill(classes, start, len, HL_COMMENT);
+                return STATE_COMMENT;
+            }
+            fill(classes, start, i, HL_COMMENT);
+        } else if (c == '"' || c == '\'') {
+            i = skip_quoted(text, len, i + 1, c);
+            fill(classes, start, i, HL_STRING);
+            if (c == '"' && i == len && continues(text, len, start + 1)) return STATE_STRING;
+        } else if (is_digit(c) || (c == '.' && i + 1 < len && is_digit(text[i + 1]))) {
+            i++;
+            while (i < len) {
+                char prev = text[i - 1];
+                bool exponent = prev == 'e' || prev == 'E' || prev == 'p' || prev == 'P';
+                if (is_ident(text[i]) || text[i] == '.' || (exponent && (text[i] == '+' || text[i] == '-'))) i++;
+                else break;
+            }
+            fill(classes, start, i, HL_NUMBER);
+        } else if (is_ident(c)) {
+            while (i < len && is_ident(text[i])) i++;
+
+            int n = i - start;
+            if (word_in(text + start, n, g_keywords)) {
+                fill(classes, start, i, HL_KEYWORD);
+            } else if (word_in(text + start, n, g_types) || (n > 2 && text[i - 2] == '_' && text[i - 1] == 't')) {
+                fill(classes, start, i, HL_TYPE);
+            }
+        } else {
+            i++;
+        }
+
+        line_start = false;
+    }
+
+    return STATE_CODE;
+}
+
+const struct hl_lexer hl_lexer_c = {
+    .name = "c",
+    .extensions = g_extensions,
+    .lex = lex,
+};
@@ -0,0 +1,143 @@
+// Copyright 2025 JesusTouchMe
+
+#include "linepool.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+struct lp_chunk {
+    struct lp_chunk* next;
+    int live; // buffers in it that are handed out
+};
+
+#define CHUNK_HEADER ((sizeof(struct lp_chunk) + 15) & ~(size_t) 15) // buffers stay 16 byte aligned
+
+static int class_of(int size) {
+    if (size <= 128) return size <= 16 ? 0 : (size - 1) / 16;
+
+    int shift = 31 - __builtin_clz(size - 1); // 2^shift < size <= 2^(shift + 1)
+    int step = 1 << (shift - 2);
+    return 8 + (shift - 7) * 4 + ((size - 1) - (1 << shift)) / step;
+}
+
+static int class_size(int c) {
+    if (c < 8) return (c + 1) * 16;
+
+    int shift = 7 + (c - 8) / 4;
+    return (1 << shift) + ((c - 8) % 4 + 1) * (1 << (shift - 2));
+}
+
+static struct lp_chunk* chunk_of(const char* buf) {
+    return (struct lp_chunk*) ((uintptr_t) buf & ~(uintptr_t) (LP_CHUNK - 1));
+}
+
+static void push(struct line_pool* lp, int c, char* buf) {
+    *(char**) buf = lp->free[c];
+    lp->free[c] = buf;
+}
+
+void lp_init(struct line_pool* lp) {
+    for (int c = 0; c < LP_CLASSES; c++) lp->free[c] = NULL;
+    lp->chunks = NULL;
+    lp->bump = NULL;
+    lp->bump_end = NULL;
+    lp->chunk_bytes = 0;
+    lp->in_use = 0;
+}
+
+void lp_destroy(struct line_pool* lp) {
+    while (lp->chunks != NULL) {
+        struct lp_chunk* next = lp->chunks->next;
+        free(lp->chunks);
+        lp->chunks = next;
+    }
+    lp_init(lp);
+}
+
+int lp_size(int size) {
+    return size > LP_MAX ? size : class_size(class_of(size));
+}
+
+// whatever is left at the end of the newest chunk is too small for what's wanted, it goes to the free lists
+// in the biggest pieces it makes before there's a new chunk
+static int new_chunk(struct line_pool* lp) {
+    struct lp_chunk* chunk = aligned_alloc(LP_CHUNK, LP_CHUNK);
+    if (chunk == NULL) return -1;
+
+    while (lp->bump_end - lp->bump >= 16) {
+        int left = lp->bump_end - lp->bump;
+        int c = class_of(left);
+        if (class_size(c) > left) c--;
+
+        push(lp, c, lp->bump);
+        lp->bump += class_size(c);
+    }
+
+    chunk->next = lp->chunks;
+    chunk->live = 0;
+    lp->chunks = chunk;
+    lp->bump = (char*) chunk + CHUNK_HEADER;
+    lp->bump_end = (char*) chunk + LP_CHUNK;
+    lp->chunk_bytes += LP_CHUNK;
+    return 0;
+}
+
+char* lp_alloc(struct line_pool* lp, int size) {
+    if (size > LP_MAX) return malloc(size);
+
+    int c = class_of(size);
+    int bytes = class_size(c);
+    char* buf = lp->free[c];
+
+    if (buf != NULL) {
+        lp->free[c] = *(char**) buf;
+    } else {
+        if (lp->bump_end - lp->bump < bytes && new_chunk(lp) != 0) return NULL;
+        buf = lp->bump;
+        lp->bump += bytes;
+    }
+
+    chunk_of(buf)->live++;
+    lp->in_use += bytes;
+    return buf;
+}
+
+void lp_free(struct line_pool* lp, char* buf, int size) {
+    if (buf == NULL) return;
+    if (size > LP_MAX) {
+        free(buf);
+        return;
+    }
+
+    int c = class_of(size);
+    push(lp, c, buf);
+    chunk_of(buf)->live--;
+    lp->in_use -= class_size(c);
+}
+
+void lp_trim(struct line_pool* lp) {
+    if (lp->chunks == NULL) return;
+
+    // the newest chunk stays for the bump allocations, everything else that's unused goes. its buffers
+    // have to come off the free lists first
+    for (int c = 0; c < LP_CLASSES; c++) {
+        char** link = &lp->free[c];
+        while (*link != NULL) {
+            struct lp_chunk* chunk = chunk_of(*link);
+            if (chunk->live == 0 && chunk != lp->chunks) *link = *(char**) *link;
+            else link = (char**) *link;
+        }
+    }
+
+    struct lp_chunk** link = &lp->chunks->next;
+    while (*link != NULL) {
+        struct lp_chunk* chunk = *link;
+        if (chunk->live == 0) {
+            *link = chunk->next;
+            free(chunk);
+            lp->chunk_bytes -= LP_CHUNK;
+        } else {
+            link = &chunk->next;
+        }
+    }
+}
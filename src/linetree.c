@@ -0,0 +1,560 @@
+// Copyright 2025 JesusTouchMe
+
+#include "linetree.h"
+#include "utf8.h"
+#include "workers.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// nodes are split on the way down before an insert and topped up on the way down before a remove,
+// so neither ever has to walk back up. that's also why nothing needs a parent pointer
+
+#define LEAF_MIN (LEAF_MAX / 4)
+#define NODE_MIN (NODE_MAX / 4)
+
+#define LEAF_FILL (LEAF_MAX * 3 / 4) // how full lt_build packs nodes, leaves room to type into
+#define NODE_FILL (NODE_MAX * 3 / 4)
+
+#define BUILD_PART_MIN (1 << 18) // lines, below that building leaves or measuring their rows stays on one thread
+
+int lt_line_rows(struct file_buffer* fb, const struct line_buffer* lb) {
+    int wrap = fb->wrap_width > 0 ? fb->wrap_width : 1;
+    int width = utf8_line_width(lb->buf, lb->gap_start, lb->buf + lb->gap_end, lb->len - lb->gap_end, wrap);
+    if (width <= 0) return 1;
+    return (width + wrap - 1) / wrap;
+}
+
+static struct line_node* node_new(bool leaf) {
+    struct line_node* node = malloc(sizeof(struct line_node));
+    if (node == NULL) return NULL;
+
+    node->leaf = leaf;
+    node->count = 0;
+    node->lines = 0;
+    node->rows = 0;
+    return node;
+}
+
+static void node_recount(struct line_node* node) {
+    node->lines = 0;
+    node->rows = 0;
+
+    if (node->leaf) {
+        node->lines = node->count;
+        for (int i = 0; i < node->count; i++) node->rows += node->line_rows[i];
+    } else {
+        for (int i = 0; i < node->count; i++) {
+            node->lines += node->child[i]->lines;
+            node->rows += node->child[i]->rows;
+        }
+    }
+}
+
+// the rows of every line in the leaf measured again, at the wrap width there is now
+static void leaf_measure(struct file_buffer* fb, struct line_node* leaf) {
+    for (int i = 0; i < leaf->count; i++) leaf->line_rows[i] = lt_line_rows(fb, &leaf->line[i]);
+    node_recount(leaf);
+}
+
+static int node_max(struct line_node* node) {
+    return node->leaf ? LEAF_MAX : NODE_MAX;
+}
+
+static int node_min(struct line_node* node) {
+    return node->leaf ? LEAF_MIN : NODE_MIN;
+}
+
+// moves count entries from src[src_pos] to dst[dst_pos], whichever kind of node they are
+static void node_move(struct line_node* dst, int dst_pos, struct line_node* src, int src_pos, int count) {
+    if (dst->leaf) {
+        memmove(&dst->line[dst_pos], &src->line[src_pos], count * sizeof(struct line_buffer));
+        memmove(&dst->line_rows[dst_pos], &src->line_rows[src_pos], count * sizeof(int));
+    } else memmove(&dst->child[dst_pos], &src->child[src_pos], count * sizeof(struct line_node*));
+}
+
+static void node_free(struct line_node* node) {
+    if (!node->leaf) {
+        for (int i = 0; i < node->count; i++) node_free(node->child[i]);
+    }
+    free(node);
+}
+
+// groups count nodes into parents, evenly so the last one isn't left nearly empty
+static struct line_node** build_level(struct line_node** nodes, int* count) {
+    int groups = (*count + NODE_FILL - 1) / NODE_FILL;
+    struct line_node** parents = malloc(groups * sizeof(struct line_node*));
+    if (parents == NULL) return NULL;
+
+    int next = 0;
+    for (int g = 0; g < groups; g++) {
+        int size = *count / groups + (g < *count % groups ? 1 : 0);
+
+        parents[g] = node_new(false);
+        if (parents[g] == NULL) {
+            for (int i = 0; i < g; i++) free(parents[i]);
+            free(parents);
+            return NULL;
+        }
+
+        memcpy(parents[g]->child, &nodes[next], size * sizeof(struct line_node*));
+        parents[g]->count = size;
+        node_recount(parents[g]);
+        next += size;
+    }
+
+    *count = groups;
+    return parents;
+}
+
+// the leaves are independent of each other, big files get them built a range of leaves per worker. a file
+// that's just been loaded has no wrap width yet, its rows are left stale for ensure_rows to measure once
+// there is one instead of measuring everything twice
+struct leaf_job {
+    struct file_buffer* fb;
+    struct line_buffer* lines;
+    int count;
+    int leaf_count;
+    int parts;
+    struct line_node** level;
+};
+
+static void build_leaves(void* ctx, int part) {
+    struct leaf_job* job = ctx;
+    int per_leaf = job->count / job->leaf_count;
+    int extra = job->count % job->leaf_count; // the first this many leaves get one more
+    int from = (int64_t) job->leaf_count * part / job->parts;
+    int to = (int64_t) job->leaf_count * (part + 1) / job->parts;
+
+    for (int l = from; l < to; l++) {
+        int next = l * per_leaf + (l < extra ? l : extra);
+        int size = per_leaf + (l < extra ? 1 : 0);
+
+        struct line_node* leaf = node_new(true);
+        job->level[l] = leaf;
+        if (leaf == NULL) return; // lt_build finds it
+
+        memcpy(leaf->line, &job->lines[next], size * sizeof(struct line_buffer));
+        leaf->count = size;
+        if (job->fb->wrap_width > 0) {
+            leaf_measure(job->fb, leaf);
+        } else { // edits before there's a wrap width still add these up, they just don't mean anything yet
+            memset(leaf->line_rows, 0, size * sizeof(int));
+            leaf->lines = size;
+        }
+    }
+}
+
+int lt_build(struct file_buffer* fb, struct line_buffer* lines, int count) {
+    int leaf_count = count > 0 ? (count + LEAF_FILL - 1) / LEAF_FILL : 1;
+    struct line_node** level = calloc(leaf_count, sizeof(struct line_node*));
+    if (level == NULL) return -1;
+
+    struct leaf_job job = {
+        .fb = fb,
+        .lines = lines,
+        .count = count,
+        .leaf_count = leaf_count,
+        .parts = workers_for(count, BUILD_PART_MIN),
+        .level = level,
+    };
+    workers_run(job.parts, build_leaves, &job);
+
+    for (int l = 0; l < leaf_count; l++) {
+        if (level[l] != NULL) continue;
+
+        for (int i = 0; i < leaf_count; i++) free(level[i]);
+        free(level);
+        return -1;
+    }
+
+    int level_count = leaf_count;
+    while (level_count > 1) {
+        struct line_node** parents = build_level(level, &level_count);
+        if (parents == NULL) {
+            // whatever got built so far hangs off level, the line_buffers still belong to the caller
+            for (int i = 0; i < level_count; i++) node_free(level[i]);
+            free(level);
+            return -1;
+        }
+
+        free(level);
+        level = parents;
+    }
+
+    fb->root = level[0];
+    fb->line_count = count;
+    fb->finger.depth = 0;
+    fb->rows_stale = fb->wrap_width <= 0;
+    free(level);
+    return 0;
+}
+
+void lt_free(struct file_buffer* fb) {
+    if (fb->root != NULL) node_free(fb->root);
+    fb->root = NULL;
+    fb->line_count = 0;
+    fb->finger.depth = 0;
+}
+
+// finds the child of node that line (relative to node) is in, and how many lines come before it
+static int child_for_line(struct line_node* node, int line, int* before) {
+    int i = 0;
+    *before = 0;
+    while (i < node->count - 1 && line - *before >= node->child[i]->lines) {
+        *before += node->child[i]->lines;
+        i++;
+    }
+    return i;
+}
+
+static void descend(struct file_buffer* fb, int line, struct line_finger* path) {
+    struct line_node* node = fb->root;
+    int start = 0;
+    int depth = 0;
+
+    while (!node->leaf) {
+        int before;
+        int i = child_for_line(node, line - start, &before);
+        start += before;
+
+        path->node[depth] = node;
+        path->pos[depth] = i;
+        depth++;
+        node = node->child[i];
+    }
+
+    path->node[depth] = node;
+    path->pos[depth] = line - start;
+    path->depth = depth + 1;
+    path->start = start;
+}
+
+struct line_buffer* lt_get(struct file_buffer* fb, int line) {
+    if (line < 0 || line >= fb->line_count) return NULL;
+
+    struct line_finger* finger = &fb->finger;
+    if (finger->depth > 0) {
+        struct line_node* leaf = finger->node[finger->depth - 1];
+        if (line >= finger->start && line < finger->start + leaf->count) {
+            finger->pos[finger->depth - 1] = line - finger->start;
+            return &leaf->line[line - finger->start];
+        }
+    }
+
+    descend(fb, line, finger);
+    return &finger->node[finger->depth - 1]->line[line - finger->start];
+}
+
+void lt_line_changed(struct file_buffer* fb, int line, int old_rows) {
+    struct line_buffer* lb = lt_get(fb, line);
+    if (lb == NULL || fb->rows_stale) return;
+
+    // lt_get left the path to this line in the finger
+    struct line_node* leaf = fb->finger.node[fb->finger.depth - 1];
+    int rows = lt_line_rows(fb, lb);
+    leaf->line_rows[fb->finger.pos[fb->finger.depth - 1]] = rows;
+
+    int delta = rows - old_rows;
+    if (delta == 0) return;
+
+    for (int d = 0; d < fb->finger.depth; d++) fb->finger.node[d]->rows += delta;
+}
+
+// splits the full child i of parent in half, the new node goes right after it
+static int split_child(struct line_node* parent, int i) {
+    struct line_node* left = parent->child[i];
+    struct line_node* right = node_new(left->leaf);
+    if (right == NULL) return -1;
+
+    int keep = left->count / 2;
+    node_move(right, 0, left, keep, left->count - keep);
+    right->count = left->count - keep;
+    left->count = keep;
+
+    node_recount(left);
+    node_recount(right);
+
+    memmove(&parent->child[i + 2], &parent->child[i + 1], (parent->count - i - 1) * sizeof(struct line_node*));
+    parent->child[i + 1] = right;
+    parent->count++;
+    return 0;
+}
+
+int lt_insert(struct file_buffer* fb, int line, const struct line_buffer* lb) {
+    if (line < 0 || line > fb->line_count) return -1;
+
+    if (fb->root->count == node_max(fb->root)) {
+        struct line_node* root = node_new(false);
+        if (root == NULL) return -1;
+
+        root->child[0] = fb->root;
+        root->count = 1;
+        node_recount(root);
+        fb->root = root;
+
+        if (split_child(root, 0) != 0) return -1;
+    }
+
+    struct line_finger path;
+    struct line_node* node = fb->root;
+    int start = 0;
+    int depth = 0;
+
+    while (!node->leaf) {
+        int before;
+        int i = child_for_line(node, line - start, &before);
+
+        if (node->child[i]->count == node_max(node->child[i])) {
+            if (split_child(node, i) != 0) return -1;
+            i = child_for_line(node, line - start, &before);
+        }
+
+        start += before;
+        path.node[depth++] = node;
+        node = node->child[i];
+    }
+
+    int pos = line - start;
+    int rows = fb->rows_stale ? 0 : lt_line_rows(fb, lb); // ensure_rows measures it along with the rest
+    memmove(&node->line[pos + 1], &node->line[pos], (node->count - pos) * sizeof(struct line_buffer));
+    memmove(&node->line_rows[pos + 1], &node->line_rows[pos], (node->count - pos) * sizeof(int));
+    node->line[pos] = *lb;
+    node->line_rows[pos] = rows;
+    node->count++;
+    path.node[depth++] = node;
+
+    for (int d = 0; d < depth; d++) {
+        path.node[d]->lines++;
+        path.node[d]->rows += rows;
+    }
+
+    fb->line_count++;
+    fb->finger.depth = 0;
+    return 0;
+}
+
+// child i of parent is at its minimum. borrow an entry from a sibling that can spare one, otherwise
+// merge with a sibling (both at the minimum, so the result always fits)
+static void top_up_child(struct line_node* parent, int i) {
+    struct line_node* child = parent->child[i];
+    struct line_node* left = i > 0 ? parent->child[i - 1] : NULL;
+    struct line_node* right = i + 1 < parent->count ? parent->child[i + 1] : NULL;
+
+    if (left != NULL && left->count > node_min(left)) {
+        node_move(child, 1, child, 0, child->count);
+        node_move(child, 0, left, left->count - 1, 1);
+        child->count++;
+        left->count--;
+        node_recount(left);
+        node_recount(child);
+        return;
+    }
+
+    if (right != NULL && right->count > node_min(right)) {
+        node_move(child, child->count, right, 0, 1);
+        node_move(right, 0, right, 1, right->count - 1);
+        child->count++;
+        right->count--;
+        node_recount(right);
+        node_recount(child);
+        return;
+    }
+
+    if (left == NULL) { // merge the right one into this one instead
+        left = child;
+        i++;
+    }
+
+    struct line_node* victim = parent->child[i];
+    node_move(left, left->count, victim, 0, victim->count);
+    left->count += victim->count;
+    node_recount(left);
+    free(victim);
+
+    memmove(&parent->child[i], &parent->child[i + 1], (parent->count - i - 1) * sizeof(struct line_node*));
+    parent->count--;
+}
+
+int lt_remove(struct file_buffer* fb, int line, struct line_buffer* out) {
+    if (line < 0 || line >= fb->line_count) return -1;
+
+    struct line_node* path[LINE_TREE_DEPTH];
+    struct line_node* node = fb->root;
+    int start = 0;
+    int depth = 0;
+
+    while (!node->leaf) {
+        int before;
+        int i = child_for_line(node, line - start, &before);
+
+        if (node->child[i]->count <= node_min(node->child[i]) && node->count > 1) {
+            top_up_child(node, i);
+            i = child_for_line(node, line - start, &before);
+        }
+
+        start += before;
+        path[depth++] = node;
+        node = node->child[i];
+    }
+
+    int pos = line - start;
+    *out = node->line[pos];
+    int rows = node->line_rows[pos];
+    memmove(&node->line[pos], &node->line[pos + 1], (node->count - pos - 1) * sizeof(struct line_buffer));
+    memmove(&node->line_rows[pos], &node->line_rows[pos + 1], (node->count - pos - 1) * sizeof(int));
+    node->count--;
+    path[depth++] = node;
+
+    for (int d = 0; d < depth; d++) {
+        path[d]->lines--;
+        path[d]->rows -= rows;
+    }
+
+    while (!fb->root->leaf && fb->root->count == 1) {
+        struct line_node* old = fb->root;
+        fb->root = old->child[0];
+        free(old);
+    }
+
+    fb->line_count--;
+    fb->finger.depth = 0;
+    return 0;
+}
+
+static int node_for_each(struct line_node* node, int (*fn)(struct line_buffer* line, void* ctx), void* ctx) {
+    for (int i = 0; i < node->count; i++) {
+        int res = node->leaf ? fn(&node->line[i], ctx) : node_for_each(node->child[i], fn, ctx);
+        if (res != 0) return res;
+    }
+    return 0;
+}
+
+int lt_for_each(struct file_buffer* fb, int (*fn)(struct line_buffer* line, void* ctx), void* ctx) {
+    return node_for_each(fb->root, fn, ctx);
+}
+
+void lt_invalidate_rows(struct file_buffer* fb) {
+    fb->rows_stale = true;
+}
+
+// measures the leaves too unless leaves is set, then they're already done
+static void node_recount_rows(struct file_buffer* fb, struct line_node* node, bool leaves) {
+    if (node->leaf) {
+        if (!leaves) leaf_measure(fb, node);
+        return;
+    }
+
+    for (int i = 0; i < node->count; i++) node_recount_rows(fb, node->child[i], leaves);
+    node_recount(node);
+}
+
+// measuring every line is a pass over the whole text, big files get it done a range of leaves per worker
+struct measure_job {
+    struct file_buffer* fb;
+    struct line_node** leaves;
+    int count;
+    int parts;
+};
+
+static int count_leaves(struct line_node* node) {
+    if (node->leaf) return 1;
+
+    int count = 0;
+    for (int i = 0; i < node->count; i++) count += count_leaves(node->child[i]);
+    return count;
+}
+
+static void collect_leaves(struct line_node* node, struct line_node** leaves, int* count) {
+    if (node->leaf) {
+        leaves[(*count)++] = node;
+        return;
+    }
+    for (int i = 0; i < node->count; i++) collect_leaves(node->child[i], leaves, count);
+}
+
+static void measure_leaves(void* ctx, int part) {
+    struct measure_job* job = ctx;
+    int from = (int64_t) job->count * part / job->parts;
+    int to = (int64_t) job->count * (part + 1) / job->parts;
+    for (int i = from; i < to; i++) leaf_measure(job->fb, job->leaves[i]);
+}
+
+static void ensure_rows(struct file_buffer* fb) {
+    if (!fb->rows_stale) return;
+    fb->rows_stale = false;
+
+    int parts = workers_for(fb->line_count, BUILD_PART_MIN);
+    struct line_node** leaves = parts > 1 ? malloc(count_leaves(fb->root) * sizeof(struct line_node*)) : NULL;
+    if (leaves == NULL) { // one thread, or not enough memory to hand them out
+        node_recount_rows(fb, fb->root, false);
+        return;
+    }
+
+    struct measure_job job = { .fb = fb, .leaves = leaves, .count = 0, .parts = parts };
+    collect_leaves(fb->root, leaves, &job.count);
+    workers_run(parts, measure_leaves, &job);
+    node_recount_rows(fb, fb->root, true);
+    free(leaves);
+}
+
+int lt_rows_before(struct file_buffer* fb, int line) {
+    ensure_rows(fb);
+    if (line <= 0) return 0;
+    if (line >= fb->line_count) return fb->root->rows;
+
+    struct line_node* node = fb->root;
+    int rows = 0;
+
+    while (!node->leaf) {
+        int i = 0;
+        while (i < node->count - 1 && line >= node->child[i]->lines) {
+            line -= node->child[i]->lines;
+            rows += node->child[i]->rows;
+            i++;
+        }
+        node = node->child[i];
+    }
+
+    for (int i = 0; i < line; i++) rows += node->line_rows[i];
+    return rows;
+}
+
+int lt_line_at_row(struct file_buffer* fb, int row, int* row_in_line) {
+    ensure_rows(fb);
+    *row_in_line = 0;
+    if (row <= 0) return 0;
+
+    if (row >= fb->root->rows) { // past the end, clamp to the last row of the last line
+        int line = fb->line_count - 1;
+        *row_in_line = lt_line_rows(fb, lt_get(fb, line)) - 1;
+        return line;
+    }
+
+    struct line_node* node = fb->root;
+    int line = 0;
+
+    while (!node->leaf) {
+        int i = 0;
+        while (i < node->count - 1 && row >= node->child[i]->rows) {
+            row -= node->child[i]->rows;
+            line += node->child[i]->lines;
+            i++;
+        }
+        node = node->child[i];
+    }
+
+    for (int i = 0; i < node->count; i++) {
+        int rows = node->line_rows[i];
+        if (row < rows) {
+            *row_in_line = row;
+            return line + i;
+        }
+
+        row -= rows;
+    }
+
+    // only reachable if the sums are off
+    *row_in_line = 0;
+    return line + node->count - 1;
+}
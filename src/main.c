@@ -1,19 +1,37 @@
 // Copyright 2025 JesusTouchMe
 
 #include "filebuf.h"
+#include "highlight.h"
+#include "keys.h"
+#include "replay.h"
+#include "search.h"
+#include "stats.h"
+#include "swap.h"
 #include "terminal.h"
 #include "tui.h"
+#include "undo.h"
+#include "utf8.h"
 
+#include <sys/poll.h>
+
+#include <errno.h>
 #include <math.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+#define MAX_REFILLS 16 // times the key ring gets read full again before a frame goes out anyway
+
+#define COMPACT_IDLE 500 // ms of nothing happening before line memory gets tidied up
+#define COMPACT_BUDGET 4096 // lines looked at per step of that, which is as long as input can be kept waiting
+
 enum editor_mode {
     MODE_NORMAL,
     MODE_INSERT,
+    MODE_PROMPT, // typing after a /, ? or : on the status line
 };
 
 const char* editor_mode_str(enum editor_mode mode) {
@@ -22,38 +40,516 @@ const char* editor_mode_str(enum editor_mode mode) {
             return "NORMAL";
         case MODE_INSERT:
             return "INSERT";
+        case MODE_PROMPT:
+            return "PROMPT";
     }
 }
 
-ssize_t read_nonblocking(int fd, char* buf, size_t size) {
-    fd_set set;
-    struct timeval tv = { .tv_sec = 0, .tv_usec = 50000 };
+// sleeps until there's input, the terminal got resized, more of the file got indexed, a search count
+// finished, an escape has waited long enough to count as one or the swap file is due or done, nothing else
+// changes what's on screen. the buffer gets compacted while it's quiet, see fb_compact. false once input
+// is gone for good
+bool wait_for_events(struct key_decoder* keys, struct file_buffer* fb, struct search* search, struct swap* swap) {
+    struct pollfd fds[5] = {
+        { .fd = term_input_fd(), .events = POLLIN },
+        { .fd = term_resize_fd(), .events = POLLIN },
+        { .fd = fb_index_fd(fb), .events = POLLIN }, // poll skips it if it's -1
+        { .fd = search_fd(search), .events = POLLIN },
+        { .fd = swap_fd(swap), .events = POLLIN },
+    };
+
+    int64_t now = keys_now();
+    int timeout = keys_timeout(keys, now);
+    int swap_wait = swap_timeout(swap, now);
+    if (swap_wait >= 0 && (timeout < 0 || swap_wait < timeout)) timeout = swap_wait;
+
+    bool compacting = false;
+    while (1) {
+        bool idle_work = timeout < 0 && fb_compact_pending(fb);
+        int ready = poll(fds, 5, !idle_work ? timeout : compacting ? 0 : COMPACT_IDLE);
+        if (ready < 0) {
+            if (errno != EINTR) return false;
+            continue;
+        }
+        if (ready > 0 || !idle_work) break;
+
+        search_lock(search);
+        compacting = fb_compact(fb, COMPACT_BUDGET);
+        search_unlock(search);
+    }
+
+    if (fds[1].revents & POLLIN) term_handle_resize();
+    return true;
+}
+
+// reads whatever input there is into the decoder, waiting up to timeout ms (-1 forever) for the first of
+// it, and into the recording if there is one. returns how much that was, -1 once input is gone for good
+int read_input(struct key_decoder* keys, struct recorder* rec, int timeout) {
+    char buf[KEYS_RING];
+    int total = 0;
+
+    while (keys_room(keys) > 0) {
+        struct pollfd fd = { .fd = term_input_fd(), .events = POLLIN };
+        if (poll(&fd, 1, total == 0 ? timeout : 0) <= 0) break;
 
-    FD_ZERO(&set);
-    FD_SET(fd, &set);
+        ssize_t n = read(fd.fd, buf, keys_room(keys));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
 
-    int ready = select(fd + 1, &set, NULL, NULL, &tv);
-    if (ready > 0) {
-        return read(fd, buf, size);
+        keys_feed(keys, buf, n);
+        record_input(rec, buf, n);
+        total += n;
     }
 
-    return 0;
+    return total;
+}
+
+// terminals send a pasted newline as \r, sometimes \r\n. returns the new length
+int paste_newlines(char* text, int len) {
+    int out = 0;
+    for (int i = 0; i < len; i++) {
+        if (text[i] == '\r') {
+            text[out++] = '\n';
+            if (i + 1 < len && text[i + 1] == '\n') i++;
+        } else {
+            text[out++] = text[i];
+        }
+    }
+    return out;
+}
+
+// everything a key can change
+struct editor {
+    struct file_buffer* fb;
+    struct undo_journal* undo;
+    struct search* search;
+
+    enum editor_mode mode;
+    int cursor_line;
+    int cursor_col;
+    char pending_op;
+
+    char prompt_kind;
+    char prompt[FB_FIND_MAX];
+    int prompt_len;
+
+    bool show_stats; // the :stats overlay above the status line
+
+    bool quit;
+};
+
+// inverts the matches in display columns [start, end) of line, which is on screen at row y. only what's
+// drawn ever gets searched for highlighting, however many matches the file has
+void highlight_matches(struct search* search, struct file_buffer* fb, int line, int start, int end, int y) {
+    int from = fb_vcol_to_col(fb, line, start) - search->len + 1;
+    int col = fb_find(fb, line, search->pattern, search->len, from, false);
+
+    while (col >= 0) {
+        int vcol = fb_col_to_vcol(fb, line, col);
+        if (vcol >= end) break;
+
+        int vend = fb_col_to_vcol(fb, line, col + search->len);
+        for (int v = vcol > start ? vcol : start; v < vend && v < end; v++) {
+            tui_set_invert(5 + v - start, y, true);
+        }
+        col = fb_find(fb, line, search->pattern, search->len, col + 1, false);
+    }
+}
+
+// draws the char at display column vcol of a row showing columns [start, end). next is where the char
+// after it starts, a tab fills everything up to there
+void draw_char(int y, int start, int end, int vcol, int next, uint32_t cp, tui_style style) {
+    int x = 5 + vcol - start;
+
+    if (cp == '\t') {
+        for (int v = vcol; v < next && v < end; v++) tui_put_styled(5 + v - start, y, ' ', style);
+    } else if (cp < 0x20 || cp == 0x7F) {
+        tui_put_styled(x, y, '^', style);
+        tui_put_styled(x + 1, y, cp == 0x7F ? '?' : cp + '@', style);
+    } else if (cp >= 0x80 && cp < 0xA0) { // c1 control codes, the terminal would act on them
+        tui_put_styled(x, y, UTF8_INVALID, style);
+    } else {
+        tui_put_styled(x, y, cp, style);
+    }
+}
+
+// the col in to_line that's as far across the screen as col is in from_line, so j and k go straight down
+int col_below(struct file_buffer* fb, int from_line, int col, int to_line) {
+    return fb_vcol_to_col(fb, to_line, fb_col_to_vcol(fb, from_line, col));
 }
 
+void clamp_cursor(struct editor* ed) {
+    if (ed->cursor_line >= ed->fb->line_count) ed->cursor_line = ed->fb->line_count - 1;
+
+    fb_set_cursor_pos(ed->fb, ed->cursor_line, ed->cursor_col);
+
+    int len = fb_line_length(ed->fb, ed->cursor_line);
+    if (ed->cursor_col > len) ed->cursor_col = len;
+    if (ed->cursor_col < 0) ed->cursor_col = 0;
+}
+
+void move_up(struct editor* ed) {
+    if (ed->cursor_line > 0) {
+        ed->cursor_col = col_below(ed->fb, ed->cursor_line, ed->cursor_col, ed->cursor_line - 1);
+        ed->cursor_line--;
+    }
+}
+
+void move_down(struct editor* ed) {
+    if (ed->cursor_line < ed->fb->line_count - 1) {
+        ed->cursor_col = col_below(ed->fb, ed->cursor_line, ed->cursor_col, ed->cursor_line + 1);
+        ed->cursor_line++;
+    }
+}
+
+void paste(struct editor* ed, char* text, int len) {
+    len = paste_newlines(text, len);
+
+    if (ed->mode == MODE_PROMPT) {
+        for (int i = 0; i < len && ed->prompt_len < (int) sizeof(ed->prompt); i++) {
+            if (text[i] >= 32 && text[i] <= 126) ed->prompt[ed->prompt_len++] = text[i];
+        }
+        return;
+    }
+
+    if (ed->mode == MODE_NORMAL) undo_begin(ed->undo); // in insert mode it's part of what's being typed
+
+    fb_set_cursor_pos(ed->fb, ed->cursor_line, ed->cursor_col);
+    int added = fb_insert_str(ed->fb, ed->cursor_line, text, len);
+    if (added > 0) {
+        int last = len;
+        while (text[last - 1] != '\n') last--;
+        ed->cursor_line += added;
+        ed->cursor_col = len - last;
+    } else if (added == 0) {
+        ed->cursor_col += len;
+    }
+}
+
+void normal_key(struct editor* ed, const struct key* key) {
+    struct file_buffer* fb = ed->fb;
+
+    char c = key->type == KEY_CHAR ? key->c : 0;
+    if (key->type == KEY_LEFT) c = 'h'; // the arrows are hjkl here
+    else if (key->type == KEY_DOWN) c = 'j';
+    else if (key->type == KEY_UP) c = 'k';
+    else if (key->type == KEY_RIGHT) c = 'l';
+
+    bool op_dl = false; // vim operator 'dl' with 'x' as a shortcut for it. for now, we only support the shortcut
+    bool op_dd = false; // same for 'd', only 'dd' works. the first 'd' waits in pending_op
+    bool op_join = false;
+
+    char op = ed->pending_op;
+    ed->pending_op = 0;
+
+    undo_begin(ed->undo); // one normal mode command (or the insert session it starts) is one undo step
+
+    if (op == 'd') {
+        op_dd = c == 'd'; // anything else just cancels it
+    } else if (c == 'q') {
+        ed->quit = true;
+        return;
+    } else if (c == 'i') {
+        ed->mode = MODE_INSERT;
+        return;
+    } else if (c == 'o') {
+        if (fb_split_line(fb, ed->cursor_line, fb_line_length(fb, ed->cursor_line)) == 0) {
+            ed->cursor_line++;
+            ed->cursor_col = 0;
+            ed->mode = MODE_INSERT;
+        }
+    } else if (c == 'h') {
+        ed->cursor_col = fb_prev_char(fb, ed->cursor_line, ed->cursor_col);
+    } else if (c == 'l') {
+        int next = fb_next_char(fb, ed->cursor_line, ed->cursor_col);
+        if (next < fb_line_length(fb, ed->cursor_line))
+            ed->cursor_col = next;
+    } else if (c == 'j') {
+        move_down(ed);
+    } else if (c == 'k') {
+        move_up(ed);
+    } else if (c == 'x') {
+        op_dl = true;
+    } else if (c == 'd') {
+        ed->pending_op = 'd';
+    } else if (c == 'J') {
+        op_join = true;
+    } else if (c == 'u') {
+        undo_undo(ed->undo, fb, &ed->cursor_line, &ed->cursor_col);
+    } else if (c == 0x12) { // ctrl-r
+        undo_redo(ed->undo, fb, &ed->cursor_line, &ed->cursor_col);
+    } else if (c == '/' || c == '?' || c == ':') {
+        ed->prompt_kind = c;
+        ed->prompt_len = 0;
+        ed->mode = MODE_PROMPT;
+    } else if (c == 'n' || c == 'N') {
+        bool backward = ed->search->backward != (c == 'N');
+        search_find(ed->search, ed->cursor_line, ed->cursor_col, backward, &ed->cursor_line, &ed->cursor_col);
+    }
+
+    clamp_cursor(ed);
+
+    int line = ed->cursor_line;
+    if (op_dl) fb_delete_chars(fb, line, fb_next_char(fb, line, ed->cursor_col) - ed->cursor_col); // the whole char
+
+    if (op_dd) {
+        fb_delete_lines(fb, line, 1);
+        if (ed->cursor_line >= fb->line_count) ed->cursor_line = fb->line_count - 1;
+        ed->cursor_col = 0;
+    }
+
+    // paged files can't join, and the indent and space edits below would go through without it
+    if (op_join && line < fb->line_count - 1 && fb->paged == NULL) {
+        // like vim, the next line loses its indent and a space goes in between
+        int next = line + 1;
+        fb_set_cursor_pos(fb, next, 0);
+        while (fb_char_at(fb, next, 0) == ' ' || fb_char_at(fb, next, 0) == '\t') {
+            fb_delete_char(fb, next);
+        }
+
+        int len = fb_line_length(fb, line);
+        if (len > 0 && fb_line_length(fb, next) > 0) {
+            fb_set_cursor_pos(fb, line, len);
+            fb_insert_char(fb, line, ' ');
+        }
+
+        if (fb_join_lines(fb, line) == 0) ed->cursor_col = len;
+    }
+}
+
+// what's typed after a :. anything it doesn't know does nothing
+void run_command(struct editor* ed) {
+    if (ed->prompt_len == 5 && memcmp(ed->prompt, "stats", 5) == 0) ed->show_stats = !ed->show_stats;
+}
+
+void prompt_key(struct editor* ed, const struct key* key) {
+    if (key->type != KEY_CHAR) return;
+
+    char c = key->c;
+    if ((c == '\r' || c == '\n') && ed->prompt_kind == ':') {
+        run_command(ed);
+        ed->mode = MODE_NORMAL;
+    } else if (c == '\r' || c == '\n') {
+        // an empty pattern searches for the last one again, like vim
+        if (ed->prompt_len > 0) search_set_pattern(ed->search, ed->prompt, ed->prompt_len, ed->prompt_kind == '?');
+        else ed->search->backward = ed->prompt_kind == '?';
+
+        search_find(ed->search, ed->cursor_line, ed->cursor_col, ed->search->backward, &ed->cursor_line, &ed->cursor_col);
+        ed->mode = MODE_NORMAL;
+    } else if (c == 0x7F || c == 0x08) {
+        if (ed->prompt_len == 0) ed->mode = MODE_NORMAL;
+        else ed->prompt_len--;
+    } else if (c >= 32 && c <= 126 && ed->prompt_len < (int) sizeof(ed->prompt)) {
+        ed->prompt[ed->prompt_len++] = c;
+    }
+}
+
+void insert_key(struct editor* ed, const struct key* key) {
+    struct file_buffer* fb = ed->fb;
+
+    if (key->type == KEY_UP) {
+        move_up(ed);
+    } else if (key->type == KEY_DOWN) {
+        move_down(ed);
+    } else if (key->type == KEY_RIGHT) {
+        ed->cursor_col = fb_next_char(fb, ed->cursor_line, ed->cursor_col);
+    } else if (key->type == KEY_LEFT) {
+        ed->cursor_col = fb_prev_char(fb, ed->cursor_line, ed->cursor_col);
+    } else if (key->type == KEY_CHAR) {
+        char c = key->c;
+        fb_set_cursor_pos(fb, ed->cursor_line, ed->cursor_col);
+        if (c == '\r' || c == '\n') {
+            if (fb_split_line(fb, ed->cursor_line, ed->cursor_col) == 0) {
+                ed->cursor_line++;
+                ed->cursor_col = 0;
+            }
+        } else if (c == '\t' || ((unsigned char) c >= 32 && c != 0x7F)) {
+            fb_insert_char(fb, ed->cursor_line, c);
+            ed->cursor_col++;
+        }
+    }
+
+    clamp_cursor(ed);
+}
+
+void handle_key(struct editor* ed, struct key* key) {
+    if (key->type == KEY_ESCAPE) {
+        ed->mode = MODE_NORMAL;
+        ed->pending_op = 0;
+    } else if (key->type == KEY_PASTE) {
+        paste(ed, key->text, key->len);
+    } else if (ed->mode == MODE_NORMAL) {
+        normal_key(ed, key);
+    } else if (ed->mode == MODE_PROMPT) {
+        prompt_key(ed, key);
+    } else {
+        insert_key(ed, key);
+    }
+}
+
+// what the last frame drew, so the next one only draws the rows that are different now
+struct view {
+    bool drawn; // false until there's been a frame, and then everything gets drawn
+    struct dimensions size;
+    int scroll;
+    int total_rows;
+    int cursor_y;
+    unsigned long search_generation;
+    bool show_stats;
+};
+
+// the text rows lines [from, end) are on now, as [*from_y, *to_y). if lines came or went or wrap into more
+// or fewer rows than before, everything below them moved and it's every row from the first one down
+void damaged_rows(struct file_buffer* fb, int from, int end, bool moved, int scroll, int height, int* from_y, int* to_y) {
+    *from_y = *to_y = 0;
+    if (from >= end && !moved) return;
+
+    *from_y = fb_rows_before(fb, from) - scroll;
+    *to_y = moved ? height : fb_rows_before(fb, end) - scroll;
+    if (*from_y < 0) *from_y = 0;
+    if (*to_y > height) *to_y = height;
+}
+
+// said once the terminal is back to normal
+struct run_report {
+    bool enabled; // the summary on stderr, for headless and replayed runs
+    const char* capture_path; // where the virtual terminal's output goes, NULL for nowhere
+    const char* stats_path; // where all of stats.h goes as json, NULL for nowhere
+};
+
+struct run_report report;
+
 void cleanupatexit() {
     tui_destroy();
     term_disable_raw();
+
+    if (report.capture_path != NULL) {
+        size_t len;
+        const char* captured = term_captured(&len);
+        FILE* f = fopen(report.capture_path, "wb");
+        if (f == NULL || fwrite(captured, 1, len, f) != len) perror(report.capture_path);
+        if (f != NULL) fclose(f);
+    }
+
+    if (report.stats_path != NULL && stats_dump(report.stats_path) != 0) perror(report.stats_path);
+
+    if (report.enabled) {
+        const struct stats_histogram* frames = stats_histogram(STATS_FRAME);
+        size_t bytes = term_bytes_written();
+        fprintf(stderr, "%llu frames, %.1f us per frame, %zu bytes written, %.1f per frame\n",
+                (unsigned long long) frames->count, frames->count > 0 ? frames->total_ns / 1e3 / frames->count : 0,
+                bytes, frames->count > 0 ? (double) bytes / frames->count : 0);
+    }
+}
+
+// a swap file was left behind. asked before the terminal is raw, so a plain line of input does
+char ask_recover(const char* path, const struct swap_info* info) {
+    char when[64];
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&info->written));
+
+    fprintf(stderr, "%s has a swap file from %s", path, when);
+    if (info->stale) fprintf(stderr, ", the file is newer than it");
+    if (info->pid_alive) fprintf(stderr, ", the editor that wrote it (pid %d) is still running", info->pid);
+    fprintf(stderr, "\n(r)ecover it, (d)elete it or (q)uit? ");
+
+    char line[16];
+    if (fgets(line, sizeof(line), stdin) == NULL) return 'q';
+    return line[0];
 }
 
 void termneatly(int sig) {
     exit(67);
 }
 
+// -u undo memory in MiB
+// -t tty|virtual|null where the screen goes, see terminal.h. the other two need keys from -r
+// -s WxH the screen size for those, 80x24 if not given
+// -c file the virtual terminal's output gets written here at exit
+// -r script replays keys from a script instead of reading them, see replay.h. quits when it's over
+// -R script records the keys that come in as a script
+// -S file the frame timings and counters from stats.h get written here at exit
+// -w r|d what to do with a swap file left behind, recover or delete it. asked if not given on a tty
 int main(int argc, char** argv) {
-    if (argc < 2) {
+    size_t undo_max = UNDO_DEFAULT_MAX;
+    const struct term_backend* backend = &term_tty;
+    struct dimensions headless_size = { 80, 24 };
+    const char* replay_path = NULL;
+    struct recorder rec = { .file = NULL };
+    char swap_answer = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "u:t:s:c:r:R:S:w:")) != -1) {
+        if (opt == 'u') {
+            undo_max = strtoull(optarg, NULL, 10) << 20; // in MiB
+        } else if (opt == 't') {
+            backend = term_backend_named(optarg);
+            if (backend == NULL) return 1;
+        } else if (opt == 's') {
+            if (sscanf(optarg, "%dx%d", &headless_size.width, &headless_size.height) != 2
+                    || headless_size.width < 1 || headless_size.height < 1) {
+                return 1;
+            }
+        } else if (opt == 'c') {
+            report.capture_path = optarg;
+        } else if (opt == 'r') {
+            replay_path = optarg;
+        } else if (opt == 'w') {
+            swap_answer = optarg[0];
+        } else if (opt == 'S') {
+            report.stats_path = optarg;
+        } else if (opt == 'R') {
+            if (rec.file != NULL) record_close(&rec);
+            if (record_open(&rec, optarg) != 0) return 1;
+        } else {
+            return 1;
+        }
+    }
+
+    if (optind >= argc) {
+        return 1;
+    }
+
+    if (backend != &term_tty && replay_path == NULL) {
+        fprintf(stderr, "the %s terminal has no keyboard, give it a script with -r\n", backend->name);
+        return 1;
+    }
+
+    // the file and whatever swap it left behind come first, there might be a question to ask about it
+    struct file_buffer fb;
+    if (open_file_buffer(&fb, argv[optind]) != 0) {
+        return 1;
+    }
+
+    struct swap swap;
+    if (swap_init(&swap, &fb) != 0) {
         return 1;
     }
 
+    struct swap_info found;
+    if (swap_find(&swap, &found) == 0) {
+        if (swap_answer == 0 && backend == &term_tty) swap_answer = ask_recover(fb.path, &found);
+
+        if (swap_answer == 'r') {
+            if (swap_recover(&swap) != 0) {
+                fprintf(stderr, "couldn't recover from the swap file, it's still there\n");
+                return 1;
+            }
+        } else if (swap_answer == 'd') {
+            swap_discard(&swap);
+        } else {
+            if (backend != &term_tty) fprintf(stderr, "%s has a swap file, -w r recovers it and -w d deletes it\n", fb.path);
+            return 1;
+        }
+    }
+
+    struct replay replay;
+    if (replay_path != NULL) {
+        if (replay_open(&replay, replay_path) != 0) return 1;
+        term_set_input_fd(replay_fd(&replay));
+        report.enabled = true;
+    }
+
+    term_use(backend, headless_size);
     term_init();
 
     term_enable_raw();
@@ -64,133 +560,116 @@ int main(int argc, char** argv) {
     signal(SIGINT, SIG_IGN);
     signal(SIGTERM, termneatly);
 
-    struct file_buffer fb;
-    if (open_file_buffer(&fb, argv[1]) != 0) {
+    struct undo_journal undo;
+    undo_init(&undo, undo_max);
+    fb.undo = &undo;
+
+    struct search search;
+    if (search_init(&search, &fb) != 0) {
         return 1;
     }
 
-    enum editor_mode mode = MODE_NORMAL;
+    // lexing a paged file from the top to wherever the view is would read the whole thing
+    struct highlight hl;
+    hl_init(&hl, fb.paged == NULL ? hl_lexer_for(fb.path) : NULL);
+
+    tui_style syntax[HL_CLASS_COUNT];
+    for (int i = 0; i < HL_CLASS_COUNT; i++) syntax[i] = i == HL_NORMAL ? 0 : TUI_FG(tui_rgb(hl_color(i)));
+    syntax[HL_COMMENT] |= TUI_ITALIC;
+
+    struct editor ed = {
+        .fb = &fb,
+        .undo = &undo,
+        .search = &search,
+        .mode = MODE_NORMAL,
+    };
 
     int scroll = 0;
-    int cursor_line = 0;
-    int cursor_col = 0;
 
-    char input_buf[8];
+    char* line_text = NULL; // the line being drawn
+    int line_text_cap = 0;
+
+    struct key_decoder keys;
+    keys_init(&keys);
+
+    char echo[16]; // the keys that came in for this frame, shown on the status line
+    int echo_len = 0;
+
+    struct view view = { .drawn = false };
+
+    bool first_frame = true;
     while (1) {
-        int n = read_nonblocking(STDIN_FILENO, input_buf, sizeof(input_buf));
-        if (n == 1 && input_buf[0] == 0x1B) {
-            mode = MODE_NORMAL;
-            goto skip_logic;
-        }
+        bool alive = first_frame || wait_for_events(&keys, &fb, &search, &swap);
+        first_frame = false;
+        int64_t frame_start = stats_now();
 
-        struct dimensions screen_size = tui_get_screen_size();
+        search_lock(&search); // the match counter stays off the buffer until this frame is out
+        if (!alive) break;
 
-        if (scroll < 0) scroll = 0;
-        int max_scroll = fb.line_count - screen_size.height;
-        if (scroll > max_scroll) scroll = max_scroll;
+        fb_index_progress(&fb);
+        search_drain(&search);
+        swap_tick(&swap, keys_now());
+
+        struct dimensions screen_size = tui_get_screen_size();
 
         int max_chars = screen_size.width - 5;
         if (max_chars < 1) max_chars = 1;
 
-        tui_clear();
-
-        if (mode == MODE_NORMAL) {
-            bool op_dl = false; // vim operator 'dl' with 'x' as a shortcut for it. for now, we only support the shortcut
-            if (n > 0) {
-                if (input_buf[0] == 'q') break;
+        fb_set_wrap_width(&fb, max_chars);
 
-                if (input_buf[0] == 'i') {
-                    mode = MODE_INSERT;
-                    goto skip_logic;
-                }
+        // scroll counts screen rows, not lines
+        int max_scroll = fb_total_rows(&fb) - (screen_size.height - 1);
+        if (scroll > max_scroll) scroll = max_scroll;
+        if (scroll < 0) scroll = 0;
 
-                if (input_buf[0] == 'h') {
-                    if (cursor_col > 0)
-                        cursor_col--;
-                } else if (input_buf[0] == 'l') {
-                    int len = fb_line_length(&fb, cursor_line);
-                    if (cursor_col < len - 1)
-                        cursor_col++;
-                } else if (input_buf[0] == 'j') {
-                    if (cursor_line < fb.line_count - 1) {
-                        cursor_line++;
-                        int len = fb_line_length(&fb, cursor_line);
-                        if (cursor_col > len) cursor_col = len;
-                    }
-                } else if (input_buf[0] == 'k') {
-                    if (cursor_line > 0) {
-                        cursor_line--;
-                        int len = fb_line_length(&fb, cursor_line);
-                        if (cursor_col > len) cursor_col = len;
-                    }
-                } else if (input_buf[0] == 'x') {
-                    op_dl = true;
-                }
+        // every key that's come in gets handled before the one render, however fast they come. a paste
+        // is waited for right here until it's all in (or gone quiet, see KEYS_PASTE_TIMEOUT), it only gets
+        // drawn once
+        echo_len = 0;
+        int refills = 0;
+        while (!ed.quit) {
+            struct key key;
+            if (!keys_next(&keys, &key, keys_now())) {
+                bool pasting = keys_pasting(&keys);
+                if (!pasting && refills++ == MAX_REFILLS) break; // input that never stops still gets drawn
+
+                // waiting on the rest of a paste only goes on until it's been quiet for a while, and the search
+                // worker gets the buffer meanwhile
+                int wait = pasting ? keys_timeout(&keys, keys_now()) : 0;
+                if (wait != 0) search_unlock(&search);
+                int got = read_input(&keys, &rec, wait);
+                if (wait != 0) search_lock(&search);
+
+                if (got < 0) alive = false;
+                if (got < 0 || (got == 0 && !pasting)) break;
+                continue;
             }
 
-            fb_set_cursor_pos(&fb, cursor_line, cursor_col);
-
-            int line_len_current = fb_line_length(&fb, cursor_line);
-            if (cursor_col > line_len_current) cursor_col = line_len_current;
-            if (cursor_col < 0) cursor_col = 0;
-
-            if (op_dl) fb_delete_char(&fb, cursor_line);
-        } else if (mode == MODE_INSERT) {
-            if (n > 0) { // the arrow key shit
-                if (n >= 3 && input_buf[0] == 0x1B && input_buf[1] == '[') {
-                    char key = input_buf[2];
-                    if (key == 'A') {
-                        if (cursor_line > 0) {
-                            cursor_line--;
-                            int len = fb_line_length(&fb, cursor_line);
-                            if (cursor_col > len) cursor_col = len;
-                        }
-                    } else if (key == 'B') {
-                        if (cursor_line < fb.line_count - 1) {
-                            cursor_line++;
-                            int len = fb_line_length(&fb, cursor_line);
-                            if (cursor_col > len) cursor_col = len;
-                        }
-                    } else if (key == 'C') {
-                        int len = fb_line_length(&fb, cursor_line);
-                        if (cursor_col < len)
-                            cursor_col++;
-                    } else if (key == 'D') {
-                        if (cursor_col > 0)
-                            cursor_col--;
-                    }
-                } else {
-                    for (int i = 0; i < n; i++) {
-                        if (input_buf[i] >= 32 && input_buf[i] <= 126) {
-                            fb_insert_char(&fb, cursor_line, input_buf[i]);
-                            cursor_col++;
-                            fb_set_cursor_pos(&fb, cursor_line, cursor_col);
-                        }
-                    }
-                }
+            if (echo_len < (int) sizeof(echo)) {
+                echo[echo_len++] = key.type == KEY_CHAR ? key.c : key.type == KEY_ESCAPE ? 0x1B : 0;
             }
 
-            fb_set_cursor_pos(&fb, cursor_line, cursor_col);
-
-            int line_len_current = fb_line_length(&fb, cursor_line);
-            if (cursor_col > line_len_current) cursor_col = line_len_current;
-            if (cursor_col < 0) cursor_col = 0;
+            handle_key(&ed, &key);
         }
 
-        skip_logic:
+        int64_t layout_start = stats_now();
 
-        int global_cursor_y = 0;
-        for (int j = 0; j < cursor_line; j++) {
-            int len = fb_line_length(&fb, j);
-            if (len <= 0) {
-                global_cursor_y += 1;
-            } else {
-                global_cursor_y += (len + max_chars - 1) / max_chars;
-            }
-        }
-        global_cursor_y += cursor_col / max_chars;
+        if (ed.quit || !alive) break;
+
+        clamp_cursor(&ed);
+
+        int cursor_line = ed.cursor_line;
+        int cursor_col = ed.cursor_col;
+        enum editor_mode mode = ed.mode;
+
+        int old_total_rows = view.total_rows;
+        struct fb_damage damage = fb_take_damage(&fb);
+        hl_update(&hl, &damage, fb.line_count);
+
+        int cursor_vcol = fb_col_to_vcol(&fb, cursor_line, cursor_col);
+        int global_cursor_y = fb_rows_before(&fb, cursor_line) + cursor_vcol / max_chars;
 
-        int visual_cursor_x = 5 + (cursor_col % max_chars);
+        int visual_cursor_x = 5 + (cursor_vcol % max_chars);
         int visual_cursor_y = global_cursor_y - scroll;
 
         int visual_height = screen_size.height - 1;
@@ -201,13 +680,74 @@ int main(int argc, char** argv) {
         if (visual_cursor_y < 0)
             scroll = global_cursor_y;
 
+        visual_cursor_y = global_cursor_y - scroll;
+
+        int first_row;
+        int first_line = fb_line_at_row(&fb, scroll, &first_row);
+
+        // only the rows that look different get drawn again, the rest keeps what the last frame put there
+        bool everything = !view.drawn || view.size.width != screen_size.width || view.size.height != screen_size.height
+                || view.search_generation != search.generation;
+
+        // scrolling by less than a screen has the terminal move the rows that stay, only the ones coming
+        // in get sent. the stats overlay stays where it is, it's drawn again anyway
+        int shift = scroll - view.scroll;
+        int scroll_rows = visual_height - (view.show_stats ? 1 : 0);
+        if (!everything && shift != 0) {
+            if (shift >= scroll_rows || -shift >= scroll_rows) everything = true;
+            else tui_scroll(0, scroll_rows, shift);
+        }
+
+        if (everything) {
+            tui_clear();
+        } else {
+            bool moved = fb.line_count != damage.old_count || fb_total_rows(&fb) != old_total_rows;
+            int from = moved && damage.old_count < damage.from ? damage.old_count : damage.from; // paged files grow
+            int end = damage.from < fb.line_count ? fb.line_count - damage.tail : from;
+
+            int row_in_line;
+            int last_line = fb_line_at_row(&fb, scroll + visual_height - 1, &row_in_line) + 1;
+            int colored = hl_changed_until(&hl, &fb, last_line);
+            if (colored > end) end = colored;
+
+            int from_y, to_y;
+            damaged_rows(&fb, from, end, moved, scroll, visual_height, &from_y, &to_y);
+            tui_clear_rows(from_y, to_y);
+            tui_clear_rows(view.cursor_y - shift, view.cursor_y - shift + 1);
+            if (view.show_stats) tui_clear_rows(screen_size.height - 2, screen_size.height - 1);
+        }
+        tui_clear_rows(visual_cursor_y, visual_cursor_y + 1);
+        tui_clear_rows(screen_size.height - 1, screen_size.height); // the status line changes all the time
+
         int y = 0;
-        for (int i = scroll; i < fb.line_count && y < visual_height; i++) {
+        for (int i = first_line; i < fb.line_count && y < visual_height; i++) {
+            int rows = fb_line_rows(&fb, i);
+            int first = i == first_line ? first_row : 0;
+
+            bool dirty = false;
+            for (int row = first; row < rows && y + row - first < visual_height && !dirty; row++) {
+                dirty = tui_row_dirty(y + row - first);
+            }
+            if (!dirty) {
+                y += rows - first;
+                continue;
+            }
+
             int line_len = fb_line_length(&fb, i);
-            int start = 0;
+            const uint8_t* classes = hl_line(&hl, &fb, i);
 
-            while ((start < line_len || start == 0) && y < visual_height) {
-                if (start == 0) {
+            if (line_len > line_text_cap) {
+                char* text = realloc(line_text, line_len);
+                if (text == NULL) break;
+                line_text = text;
+                line_text_cap = line_len;
+            }
+            if (fb_read_line(&fb, i, line_text) != line_len) line_len = 0;
+
+            for (int row = first; row < rows && y < visual_height; row++, y++) {
+                if (!tui_row_dirty(y)) continue;
+
+                if (row == 0) {
                     char numbuf[8];
                     snprintf(numbuf, sizeof(numbuf), "%-4d", i + 1);
                     for (int x = 0; numbuf[x] != 0 && x < screen_size.width; x++) {
@@ -215,12 +755,25 @@ int main(int argc, char** argv) {
                     }
                 }
 
-                for (int x = 0; x < max_chars && start + x < line_len; x++) {
-                    tui_put(x + 5, y, fb_char_at(&fb, i, start + x));
+                // the row shows display columns [start, end) of the line
+                int start = row * max_chars;
+                int end = start + max_chars;
+
+                int col = fb_vcol_to_col(&fb, i, start);
+                int vcol = fb_col_to_vcol(&fb, i, col);
+                while (col < line_len && vcol < end) {
+                    uint32_t cp;
+                    int next = col + utf8_decode(line_text + col, line_len - col, &cp);
+                    int next_vcol = fb_col_to_vcol(&fb, i, next);
+
+                    tui_style style = classes != NULL ? syntax[classes[col]] : 0;
+                    if (vcol >= start || cp == '\t') draw_char(y, start, end, vcol > start ? vcol : start, next_vcol, cp, style);
+
+                    col = next;
+                    vcol = next_vcol;
                 }
 
-                start += max_chars;
-                y++;
+                if (search.len > 0) highlight_matches(&search, &fb, i, start, end, y);
             }
         }
 
@@ -232,15 +785,31 @@ int main(int argc, char** argv) {
         {
             int y = screen_size.height - 1;
 
-            const char* mode_str = editor_mode_str(mode);
-            int len = strlen(mode_str);
+            char status[FB_FIND_MAX + 32];
+            int len;
+            if (mode == MODE_PROMPT) {
+                len = snprintf(status, sizeof(status), "%c%.*s", ed.prompt_kind, ed.prompt_len, ed.prompt);
+            } else if (search.len > 0 && search.count >= 0) {
+                len = snprintf(status, sizeof(status), "%s  [%ld match%s]", editor_mode_str(mode), search.count,
+                               search.count == 1 ? "" : "es");
+            } else if (search.len > 0) {
+                len = snprintf(status, sizeof(status), "%s  [counting]", editor_mode_str(mode));
+            } else {
+                len = snprintf(status, sizeof(status), "%s", editor_mode_str(mode));
+            }
+            if (len > screen_size.width) len = screen_size.width;
 
             for (int i = 0; i < len; i++) {
-                tui_put(i, y, mode_str[i]);
+                tui_put(i, y, status[i]);
             }
 
-            char pos[32];
-            len = snprintf(pos, sizeof(pos), "%d,%d", cursor_line + 1, cursor_col + 1);
+            // like vim, the display column goes next to the byte one when they differ
+            char pos[48];
+            if (cursor_vcol != cursor_col) {
+                len = snprintf(pos, sizeof(pos), "%d,%d-%d", cursor_line + 1, cursor_col + 1, cursor_vcol + 1);
+            } else {
+                len = snprintf(pos, sizeof(pos), "%d,%d", cursor_line + 1, cursor_col + 1);
+            }
             int start_x = screen_size.width - len;
             if (start_x < 0) start_x = 0;
 
@@ -250,8 +819,8 @@ int main(int argc, char** argv) {
 
             start_x -= 16;
 
-            for (int i = 0; i < n; i++) {
-                char c = input_buf[i];
+            for (int i = 0; i < echo_len; i++) {
+                char c = echo[i];
                 if (c == 0x1B) c = '^';
                 else if (c < 32 || c > 126) c = '?';
 
@@ -259,11 +828,46 @@ int main(int argc, char** argv) {
             }
         }
 
+        view = (struct view) {
+            .drawn = true,
+            .size = screen_size,
+            .scroll = scroll,
+            .total_rows = fb_total_rows(&fb),
+            .cursor_y = visual_cursor_y,
+            .search_generation = search.generation,
+            .show_stats = ed.show_stats,
+        };
+
+        if (ed.show_stats && screen_size.height > 1) {
+            char line[256];
+            int len = stats_summary(line, sizeof(line));
+            if (len > (int) sizeof(line) - 1) len = sizeof(line) - 1;
+
+            int y = screen_size.height - 2;
+            for (int x = 0; x < screen_size.width; x++) {
+                tui_put_styled(x, y, x < len ? line[x] : ' ', TUI_INVERT);
+            }
+        }
+
+        stats_time(STATS_LAYOUT, layout_start);
         tui_render();
+        search_unlock(&search);
+
+        stats_time(STATS_FRAME, frame_start);
     }
 
-    save_file_buffer(&fb);
+    search_unlock(&search);
+    search_destroy(&search);
+
+    bool saved = save_file_buffer(&fb) == 0;
+    swap_destroy(&swap, !saved); // the swap file is all that's left of the changes if that didn't work
     close_file_buffer(&fb);
+    undo_free(&undo);
+    hl_free(&hl);
+    free(line_text);
+    keys_free(&keys);
+    record_close(&rec);
+    if (replay_path != NULL) replay_close(&replay);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,683 @@
+// Copyright 2025 JesusTouchMe
+
+#include "paged.h"
+#include "utf8.h"
+#include "scan.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PAGED_MIN_FILE ((size_t) 4 << 30) // or a quarter of the ram, whichever is less
+
+#define INDEX_BATCH 4096
+#define NOTIFY_EVERY 64 // pages
+
+bool pg_wants(size_t size) {
+    size_t limit = PAGED_MIN_FILE;
+
+    long ram_pages = sysconf(_SC_PHYS_PAGES);
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (ram_pages > 0 && page_size > 0 && (size_t) ram_pages * page_size / 4 < limit) {
+        limit = (size_t) ram_pages * page_size / 4;
+    }
+
+    return size >= limit;
+}
+
+static int read_at(int fd, char* buf, size_t size, uint64_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = pread(fd, buf + done, size - done, offset + done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) return -1; // the file shrank under us
+        done += n;
+    }
+    return 0;
+}
+
+static int write_all(int fd, const char* buf, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, buf, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static int page_size_of(struct paged_file* pf, int64_t index) {
+    uint64_t offset = (uint64_t) index * PAGE_BYTES;
+    return pf->size - offset < PAGE_BYTES ? (int) (pf->size - offset) : PAGE_BYTES;
+}
+
+static int rows_for_width(struct file_buffer* fb, int width) {
+    int wrap = fb->wrap_width > 0 ? fb->wrap_width : 1;
+    if (width <= 0) return 1;
+    return (width + wrap - 1) / wrap;
+}
+
+static int clamp_int(int64_t n) {
+    return n > INT_MAX ? INT_MAX : (int) n;
+}
+
+// ---- background index ----
+
+// counts the lines starting in page index. a '\n' at the very end of a page starts a line in the next
+// one, so that goes into *carry instead
+static int index_page(struct paged_file* pf, int64_t index, char* buf, uint32_t* carry) {
+    int size = page_size_of(pf, index);
+    uint64_t offset = (uint64_t) index * PAGE_BYTES;
+    if (read_at(pf->fd, buf, size, offset) != 0) return -1;
+
+    uint32_t count = *carry;
+    *carry = 0;
+
+    size_t newlines[INDEX_BATCH];
+    size_t pos = 0;
+    while (pos < (size_t) size) {
+        size_t n = scan_newlines(buf, size, &pos, newlines, INDEX_BATCH);
+        for (size_t i = 0; i < n; i++) {
+            size_t start = newlines[i] + 1;
+            if (offset + start >= pf->size) continue; // a trailing '\n' doesn't start another line
+            if (start == (size_t) size) (*carry)++;
+            else count++;
+        }
+    }
+
+    pf->page_lines[index] = count;
+    pf->first_line[index + 1] = pf->first_line[index] + count;
+
+    // we won't be back for a while, don't let the whole file pile up in the page cache
+    posix_fadvise(pf->fd, offset, size, POSIX_FADV_DONTNEED);
+
+    atomic_store_explicit(&pf->indexed, index + 1, memory_order_release);
+    return 0;
+}
+
+static void index_notify(struct paged_file* pf) {
+    char c = 0;
+    write(pf->notify[1], &c, 1); // full pipe is fine, there's already something to wake up for
+}
+
+static void* index_thread(void* arg) {
+    struct paged_file* pf = arg;
+
+    char* buf = malloc(PAGE_BYTES);
+    if (buf == NULL) {
+        index_notify(pf);
+        return NULL;
+    }
+
+    uint32_t carry = pf->carry;
+    for (int64_t i = 1; i < pf->page_count; i++) {
+        if (atomic_load_explicit(&pf->stop, memory_order_relaxed)) break;
+        if (index_page(pf, i, buf, &carry) != 0) break; // whatever comes after stays unreachable
+
+        if (i % NOTIFY_EVERY == 0) index_notify(pf);
+    }
+
+    free(buf);
+    index_notify(pf);
+    return NULL;
+}
+
+// ---- rows ----
+
+static void rows_add(struct paged_file* pf, int64_t index, int64_t delta) {
+    pf->page_rows[index] += delta;
+    for (int64_t i = index + 1; i <= pf->page_count; i += i & -i) pf->row_tree[i] += delta;
+}
+
+static int64_t rows_prefix(struct paged_file* pf, int64_t index) { // rows in pages before index
+    int64_t sum = 0;
+    for (int64_t i = index; i > 0; i -= i & -i) sum += pf->row_tree[i];
+    return sum;
+}
+
+// the page whose rows contain row, or page_count if row is past the end
+static int64_t rows_find(struct paged_file* pf, int64_t row) {
+    int64_t pos = 0;
+    int64_t step = 1;
+    while (step * 2 <= pf->page_count) step *= 2;
+
+    for (; step > 0; step /= 2) {
+        if (pos + step <= pf->page_count && pf->row_tree[pos + step] <= row) {
+            pos += step;
+            row -= pf->row_tree[pos];
+        }
+    }
+    return pos;
+}
+
+static void rows_rebuild(struct paged_file* pf) {
+    memset(pf->row_tree, 0, (pf->page_count + 1) * sizeof(int64_t));
+    for (int64_t i = 1; i <= pf->page_count; i++) {
+        pf->row_tree[i] += pf->page_rows[i - 1];
+        int64_t parent = i + (i & -i);
+        if (parent <= pf->page_count) pf->row_tree[parent] += pf->row_tree[i];
+    }
+}
+
+// ---- open/close ----
+
+int pg_open(struct file_buffer* fb, size_t size) {
+    struct paged_file* pf = calloc(1, sizeof(struct paged_file));
+    if (pf == NULL) return -1;
+
+    pf->fd = fb->fd;
+    pf->size = size;
+    pf->page_count = (size + PAGE_BYTES - 1) / PAGE_BYTES;
+    pf->notify[0] = -1;
+    pf->notify[1] = -1;
+
+    char last;
+    pf->page_lines = calloc(pf->page_count, sizeof(uint32_t));
+    pf->first_line = calloc(pf->page_count + 1, sizeof(int64_t));
+    pf->row_tree = calloc(pf->page_count + 1, sizeof(int64_t));
+    pf->page_rows = calloc(pf->page_count, sizeof(int64_t));
+    pf->page_width = calloc(pf->page_count, sizeof(int));
+    char* buf = malloc(PAGE_BYTES);
+
+    if (pf->page_lines == NULL || pf->first_line == NULL || pf->row_tree == NULL || pf->page_rows == NULL
+            || pf->page_width == NULL || buf == NULL || read_at(pf->fd, &last, 1, size - 1) != 0) {
+        goto fail;
+    }
+    pf->ends_with_newline = last == '\n';
+
+    for (int i = 0; i < PAGE_CACHE_MAX; i++) {
+        struct page* pg = &pf->pages[i];
+        pg->index = -1;
+        pg->prev = i > 0 ? &pf->pages[i - 1] : NULL;
+        pg->next = i + 1 < PAGE_CACHE_MAX ? &pf->pages[i + 1] : NULL;
+    }
+    pf->lru_head = &pf->pages[0];
+    pf->lru_tail = &pf->pages[PAGE_CACHE_MAX - 1];
+
+    for (int i = 0; i < LINE_CACHE_MAX; i++) pf->line_cache[i].line = -1;
+
+    // the first page is done right here so there's always a line to show, the thread does the rest
+    pf->carry = 1; // line 0
+    if (index_page(pf, 0, buf, &pf->carry) != 0) goto fail;
+    free(buf);
+    buf = NULL;
+
+    if (pipe(pf->notify) != 0) goto fail;
+    for (int i = 0; i < 2; i++) {
+        fcntl(pf->notify[i], F_SETFL, fcntl(pf->notify[i], F_GETFL) | O_NONBLOCK);
+        fcntl(pf->notify[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    fb->paged = pf;
+    pg_index_progress(fb);
+
+    if (pf->page_count > 1) {
+        if (pthread_create(&pf->thread, NULL, index_thread, pf) != 0) {
+            fb->paged = NULL;
+            goto fail;
+        }
+        pf->thread_running = true;
+    }
+
+    return 0;
+
+    fail:
+    free(buf);
+    if (pf->notify[0] >= 0) close(pf->notify[0]);
+    if (pf->notify[1] >= 0) close(pf->notify[1]);
+    free(pf->page_lines);
+    free(pf->first_line);
+    free(pf->row_tree);
+    free(pf->page_rows);
+    free(pf->page_width);
+    free(pf);
+    return -1;
+}
+
+void pg_close(struct file_buffer* fb) {
+    struct paged_file* pf = fb->paged;
+    if (pf == NULL) return;
+
+    if (pf->thread_running) {
+        atomic_store(&pf->stop, true);
+        pthread_join(pf->thread, NULL);
+    }
+
+    // saving leaves fb->fd on the new file, the original is still ours to close
+    if (pf->fd != fb->fd) close(pf->fd);
+
+    close(pf->notify[0]);
+    close(pf->notify[1]);
+
+    for (int i = 0; i < PAGE_CACHE_MAX; i++) {
+        free(pf->pages[i].data);
+        free(pf->pages[i].starts);
+    }
+
+    for (int i = 0; i < pf->overlay_count; i++) lp_free(&fb->pool, pf->overlays[i].lb.buf, pf->overlays[i].lb.len);
+    free(pf->overlays);
+
+    free(pf->page_lines);
+    free(pf->first_line);
+    free(pf->row_tree);
+    free(pf->page_rows);
+    free(pf->page_width);
+    free(pf);
+    fb->paged = NULL;
+}
+
+int pg_index_fd(struct file_buffer* fb) {
+    return fb->paged->notify[0];
+}
+
+void pg_index_progress(struct file_buffer* fb) {
+    struct paged_file* pf = fb->paged;
+
+    char drain[64];
+    while (read(pf->notify[0], drain, sizeof(drain)) > 0) {}
+
+    int64_t indexed = atomic_load_explicit(&pf->indexed, memory_order_acquire);
+    for (int64_t i = pf->seen; i < indexed; i++) {
+        pf->page_width[i] = 0;
+        rows_add(pf, i, pf->page_lines[i]); // one row per line until the page is looked at
+    }
+    pf->seen = indexed;
+
+    int lines = clamp_int(pf->first_line[indexed]);
+    fb->line_count = lines > 0 ? lines : 1;
+}
+
+// ---- pages ----
+
+static void lru_touch(struct paged_file* pf, struct page* pg) {
+    if (pf->lru_head == pg) return;
+
+    pg->prev->next = pg->next;
+    if (pg->next != NULL) pg->next->prev = pg->prev;
+    else pf->lru_tail = pg->prev;
+
+    pg->prev = NULL;
+    pg->next = pf->lru_head;
+    pf->lru_head->prev = pg;
+    pf->lru_head = pg;
+}
+
+static int page_add_start(struct page* pg, int start) {
+    if (pg->start_count == pg->start_cap) {
+        int new_cap = pg->start_cap == 0 ? 1024 : pg->start_cap * 2;
+        int* tmp = realloc(pg->starts, new_cap * sizeof(int));
+        if (tmp == NULL) return -1;
+
+        pg->starts = tmp;
+        pg->start_cap = new_cap;
+    }
+
+    pg->starts[pg->start_count++] = start;
+    return 0;
+}
+
+static int page_decode(struct paged_file* pf, struct page* pg, int64_t index) {
+    if (pg->data == NULL && (pg->data = malloc(PAGE_BYTES)) == NULL) return -1;
+
+    uint64_t offset = (uint64_t) index * PAGE_BYTES;
+    pg->size = page_size_of(pf, index);
+    pg->start_count = 0;
+    if (read_at(pf->fd, pg->data, pg->size, offset) != 0) return -1;
+
+    char before = '\n';
+    if (index > 0 && read_at(pf->fd, &before, 1, offset - 1) != 0) return -1;
+    if (before == '\n' && page_add_start(pg, 0) != 0) return -1;
+
+    size_t newlines[INDEX_BATCH];
+    size_t pos = 0;
+    while (pos < (size_t) pg->size) {
+        size_t n = scan_newlines(pg->data, pg->size, &pos, newlines, INDEX_BATCH);
+        for (size_t i = 0; i < n; i++) {
+            size_t start = newlines[i] + 1;
+            if (start == (size_t) pg->size) continue; // belongs to the next page, or is the end of the file
+            if (page_add_start(pg, start) != 0) return -1;
+        }
+    }
+
+    return 0;
+}
+
+static struct page* page_get(struct paged_file* pf, int64_t index) {
+    for (struct page* pg = pf->lru_head; pg != NULL && pg->index >= 0; pg = pg->next) {
+        if (pg->index == index) {
+            lru_touch(pf, pg);
+            return pg;
+        }
+    }
+
+    struct page* pg = pf->lru_tail;
+    pg->index = -1;
+    if (page_decode(pf, pg, index) != 0) return NULL;
+
+    pg->index = index;
+    lru_touch(pf, pg);
+    return pg;
+}
+
+// ---- lines ----
+
+// the page line starts in, -1 if it isn't indexed (yet)
+static int64_t page_of_line(struct paged_file* pf, int line) {
+    if (line < 0 || line >= pf->first_line[pf->seen]) return -1;
+
+    int64_t lo = 0;
+    int64_t hi = pf->seen - 1;
+    while (lo < hi) { // first page whose lines go past line
+        int64_t mid = lo + (hi - lo) / 2;
+        if (pf->first_line[mid + 1] > line) hi = mid;
+        else lo = mid + 1;
+    }
+    return lo;
+}
+
+// where the line after the last one starting in page index starts, minus its '\n'
+static uint64_t line_end_after(struct paged_file* pf, int64_t index) {
+    for (int64_t i = index + 1; i < pf->page_count; i++) {
+        if (i < pf->seen && pf->page_lines[i] == 0) continue; // known to have no lines, don't read it
+
+        struct page* pg = page_get(pf, i);
+        if (pg == NULL) break;
+        if (pg->start_count > 0) return (uint64_t) i * PAGE_BYTES + pg->starts[0] - 1;
+    }
+
+    return pf->ends_with_newline ? pf->size - 1 : pf->size;
+}
+
+static struct line_slot* line_locate(struct paged_file* pf, int line) {
+    if (line < 0) return NULL;
+
+    struct line_slot* slot = &pf->line_cache[line % LINE_CACHE_MAX];
+    if (slot->line == line) return slot;
+
+    int64_t index = page_of_line(pf, line);
+    if (index < 0) return NULL;
+
+    struct page* pg = page_get(pf, index);
+    if (pg == NULL) return NULL;
+
+    int k = line - pf->first_line[index];
+    if (k >= pg->start_count) return NULL; // the file changed under us
+
+    uint64_t start = (uint64_t) index * PAGE_BYTES + pg->starts[k];
+    uint64_t end = k + 1 < pg->start_count
+            ? (uint64_t) index * PAGE_BYTES + pg->starts[k + 1] - 1
+            : line_end_after(pf, index);
+
+    slot->line = line;
+    slot->start = start;
+    slot->len = clamp_int(end - start);
+    return slot;
+}
+
+static int overlay_find(struct paged_file* pf, int line) { // index of the first overlay >= line
+    int lo = 0;
+    int hi = pf->overlay_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (pf->overlays[mid].line < line) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+struct line_buffer* pg_overlay(struct file_buffer* fb, int line) {
+    struct paged_file* pf = fb->paged;
+    int i = overlay_find(pf, line);
+    if (i < pf->overlay_count && pf->overlays[i].line == line) return &pf->overlays[i].lb;
+    return NULL;
+}
+
+struct line_buffer* pg_add_overlay(struct file_buffer* fb, int line, const struct line_buffer* lb) {
+    struct paged_file* pf = fb->paged;
+
+    struct line_slot* slot = line_locate(pf, line);
+    if (slot == NULL) return NULL;
+
+    if (pf->overlay_count == pf->overlay_cap) {
+        int new_cap = pf->overlay_cap == 0 ? 16 : pf->overlay_cap * 2;
+        struct line_overlay* tmp = realloc(pf->overlays, new_cap * sizeof(struct line_overlay));
+        if (tmp == NULL) return NULL;
+
+        pf->overlays = tmp;
+        pf->overlay_cap = new_cap;
+    }
+
+    int i = overlay_find(pf, line);
+    memmove(&pf->overlays[i + 1], &pf->overlays[i], (pf->overlay_count - i) * sizeof(struct line_overlay));
+    pf->overlay_count++;
+
+    struct line_overlay* ov = &pf->overlays[i];
+    ov->line = line;
+    ov->start = slot->start;
+    ov->orig_len = slot->len;
+    ov->lb = *lb;
+    return &ov->lb;
+}
+
+char pg_char_at(struct file_buffer* fb, int line, int col) {
+    struct paged_file* pf = fb->paged;
+
+    struct line_slot* slot = line_locate(pf, line);
+    if (slot == NULL || col < 0 || col >= slot->len) return 0;
+
+    uint64_t offset = slot->start + col;
+    struct page* pg = page_get(pf, offset / PAGE_BYTES);
+    if (pg == NULL) return 0;
+    return pg->data[offset % PAGE_BYTES];
+}
+
+int pg_line_length(struct file_buffer* fb, int line) {
+    struct line_slot* slot = line_locate(fb->paged, line);
+    return slot != NULL ? slot->len : -1;
+}
+
+int pg_read_line(struct file_buffer* fb, int line, char* out) {
+    struct paged_file* pf = fb->paged;
+
+    struct line_slot* slot = line_locate(pf, line);
+    if (slot == NULL) return -1;
+
+    uint64_t offset = slot->start;
+    int len = slot->len;
+    int done = 0;
+    while (done < len) {
+        struct page* pg = page_get(pf, offset / PAGE_BYTES);
+        if (pg == NULL) return -1;
+
+        int in_page = offset % PAGE_BYTES;
+        int n = pg->size - in_page < len - done ? pg->size - in_page : len - done;
+        memcpy(out + done, pg->data + in_page, n);
+        done += n;
+        offset += n;
+    }
+
+    return len;
+}
+
+static int line_length_now(struct file_buffer* fb, int line) {
+    struct line_buffer* lb = pg_overlay(fb, line);
+    if (lb != NULL) return lb->gap_start + (lb->len - lb->gap_end);
+    return pg_line_length(fb, line);
+}
+
+// display width of a line as it is in the file. it's measured where it lies in the page cache, only a
+// line running over more than two pages gets copied out first
+static int original_width(struct file_buffer* fb, struct line_slot* slot) {
+    struct paged_file* pf = fb->paged;
+    int wrap = fb->wrap_width > 0 ? fb->wrap_width : 1;
+
+    struct page* pg = page_get(pf, slot->start / PAGE_BYTES);
+    if (pg == NULL) return slot->len;
+
+    int in_page = slot->start % PAGE_BYTES;
+    int a_len = pg->size - in_page;
+    if (slot->len <= a_len) return utf8_line_width(pg->data + in_page, slot->len, NULL, 0, wrap);
+
+    const char* a = pg->data + in_page;
+    struct page* next = page_get(pf, slot->start / PAGE_BYTES + 1); // pg was just used, this can't evict it
+    if (next != NULL && slot->len - a_len <= next->size) {
+        return utf8_line_width(a, a_len, next->data, slot->len - a_len, wrap);
+    }
+
+    int len = slot->len;
+    char* copy = malloc(len);
+    if (copy == NULL || pg_read_line(fb, slot->line, copy) != len) {
+        free(copy);
+        return len;
+    }
+
+    int width = utf8_line_width(copy, len, NULL, 0, wrap);
+    free(copy);
+    return width;
+}
+
+static int line_rows_now(struct file_buffer* fb, int line) {
+    struct line_buffer* lb = pg_overlay(fb, line);
+    if (lb != NULL) {
+        int wrap = fb->wrap_width > 0 ? fb->wrap_width : 1;
+        return rows_for_width(fb, utf8_line_width(lb->buf, lb->gap_start, lb->buf + lb->gap_end, lb->len - lb->gap_end, wrap));
+    }
+
+    struct line_slot* slot = line_locate(fb->paged, line);
+    if (slot == NULL) return 1;
+    return rows_for_width(fb, original_width(fb, slot));
+}
+
+int pg_line_rows(struct file_buffer* fb, int line) {
+    if (line_length_now(fb, line) < 0) return 0;
+    return line_rows_now(fb, line);
+}
+
+// ---- rows ----
+
+static void page_count_rows(struct file_buffer* fb, int64_t index) {
+    struct paged_file* pf = fb->paged;
+    if (pf->page_width[index] == fb->wrap_width) return;
+
+    int64_t rows = 0;
+    int64_t first = pf->first_line[index];
+    for (int64_t i = 0; i < pf->page_lines[index] && first + i < INT_MAX; i++) {
+        rows += line_rows_now(fb, first + i);
+    }
+
+    rows_add(pf, index, rows - pf->page_rows[index]);
+    pf->page_width[index] = fb->wrap_width;
+}
+
+void pg_line_changed(struct file_buffer* fb, int line, int old_rows) {
+    struct paged_file* pf = fb->paged;
+
+    int64_t index = page_of_line(pf, line);
+    if (index < 0 || pf->page_width[index] != fb->wrap_width) return; // still a guess, nothing to keep up to date
+
+    int delta = line_rows_now(fb, line) - old_rows;
+    if (delta != 0) rows_add(pf, index, delta);
+}
+
+void pg_set_wrap_width(struct file_buffer* fb) {
+    struct paged_file* pf = fb->paged;
+
+    for (int64_t i = 0; i < pf->seen; i++) {
+        pf->page_rows[i] = pf->page_lines[i];
+        pf->page_width[i] = 0;
+    }
+    rows_rebuild(pf);
+}
+
+int pg_rows_before(struct file_buffer* fb, int line) {
+    struct paged_file* pf = fb->paged;
+    if (line >= fb->line_count) return pg_total_rows(fb);
+
+    int64_t index = page_of_line(pf, line);
+    if (index < 0) return 0;
+
+    page_count_rows(fb, index); // otherwise the guess for it could be less than what's counted below
+    int64_t rows = rows_prefix(pf, index);
+    for (int64_t i = pf->first_line[index]; i < line; i++) rows += line_rows_now(fb, i);
+    return clamp_int(rows);
+}
+
+int pg_total_rows(struct file_buffer* fb) {
+    return clamp_int(rows_prefix(fb->paged, fb->paged->seen));
+}
+
+int pg_line_at_row(struct file_buffer* fb, int row, int* row_in_line) {
+    struct paged_file* pf = fb->paged;
+
+    if (row < 0) row = 0;
+    if (row >= pg_total_rows(fb)) {
+        int last = fb->line_count - 1;
+        *row_in_line = line_rows_now(fb, last) - 1;
+        return last;
+    }
+
+    // pages are only counted for real once they're needed, which moves everything after them
+    int64_t index;
+    while (1) {
+        index = rows_find(pf, row);
+        if (index >= pf->seen || pf->page_width[index] == fb->wrap_width) break;
+        page_count_rows(fb, index);
+    }
+
+    int64_t left = row - rows_prefix(pf, index);
+    int64_t line = pf->first_line[index];
+    for (; line + 1 < fb->line_count; line++) {
+        int rows = line_rows_now(fb, line);
+        if (left < rows) break;
+        left -= rows;
+    }
+
+    *row_in_line = left;
+    return line;
+}
+
+// ---- saving ----
+
+static int copy_range(struct paged_file* pf, int fd, char* buf, uint64_t from, uint64_t to) {
+    while (from < to) {
+        size_t n = to - from < PAGE_BYTES ? to - from : PAGE_BYTES;
+        if (read_at(pf->fd, buf, n, from) != 0 || write_all(fd, buf, n) != 0) return -1;
+        from += n;
+    }
+    return 0;
+}
+
+int pg_write(struct file_buffer* fb, int fd) {
+    struct paged_file* pf = fb->paged;
+
+    char* buf = malloc(PAGE_BYTES);
+    if (buf == NULL) return -1;
+
+    uint64_t pos = 0;
+    for (int i = 0; i < pf->overlay_count; i++) {
+        struct line_overlay* ov = &pf->overlays[i];
+        struct line_buffer* lb = &ov->lb;
+
+        if (copy_range(pf, fd, buf, pos, ov->start) != 0
+                || write_all(fd, lb->buf, lb->gap_start) != 0
+                || write_all(fd, lb->buf + lb->gap_end, lb->len - lb->gap_end) != 0) {
+            free(buf);
+            return -1;
+        }
+
+        pos = ov->start + ov->orig_len; // its '\n' comes along with the next range
+    }
+
+    int result = copy_range(pf, fd, buf, pos, pf->size);
+    free(buf);
+    return result;
+}
@@ -0,0 +1,246 @@
+// Copyright 2025 JesusTouchMe
+
+#include "replay.h"
+#include "keys.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// the escapes in text[0, len) undone into out, which needs room for len. -1 if one of them is broken
+static int unescape(const char* text, int len, char* out) {
+    int n = 0;
+    for (int i = 0; i < len; i++) {
+        if (text[i] != '\\') {
+            out[n++] = text[i];
+            continue;
+        }
+
+        if (++i == len) return -1;
+        switch (text[i]) {
+            case 'e': out[n++] = 0x1B; break;
+            case 'r': out[n++] = '\r'; break;
+            case 'n': out[n++] = '\n'; break;
+            case 't': out[n++] = '\t'; break;
+            case '\\': out[n++] = '\\'; break;
+            case 'x': {
+                int hi = i + 1 < len ? hex_digit(text[i + 1]) : -1;
+                int lo = i + 2 < len ? hex_digit(text[i + 2]) : -1;
+                if (hi < 0 || lo < 0) return -1;
+                out[n++] = (char) (hi << 4 | lo);
+                i += 2;
+                break;
+            }
+            default: return -1;
+        }
+    }
+    return n;
+}
+
+static int parse(struct replay* r, FILE* f, const char* path) {
+    char* line = NULL;
+    size_t line_cap = 0;
+    ssize_t line_len;
+    int line_no = 0;
+    int data_len = 0;
+    int data_cap = 0;
+    int cap = 0;
+
+    while ((line_len = getline(&line, &line_cap, f)) >= 0) {
+        line_no++;
+        if (line_len > 0 && line[line_len - 1] == '\n') line[--line_len] = '\0';
+        if (line_len == 0 || line[0] == '#') continue;
+
+        char* text;
+        long delay = strtol(line, &text, 10);
+        if (text == line || delay < 0 || (*text != ' ' && *text != '\0')) goto bad;
+        if (*text == ' ') text++;
+        int text_len = line_len - (text - line);
+
+        if (r->count == cap) {
+            int new_cap = cap == 0 ? 64 : cap * 2;
+            struct replay_chunk* tmp = realloc(r->chunks, new_cap * sizeof(struct replay_chunk));
+            if (tmp == NULL) goto oom;
+            r->chunks = tmp;
+            cap = new_cap;
+        }
+        if (data_len + text_len > data_cap) {
+            int new_cap = data_cap == 0 ? 4096 : data_cap;
+            while (new_cap < data_len + text_len) new_cap *= 2;
+            char* tmp = realloc(r->data, new_cap);
+            if (tmp == NULL) goto oom;
+            r->data = tmp;
+            data_cap = new_cap;
+        }
+
+        int len = unescape(text, text_len, r->data + data_len);
+        if (len < 0) goto bad;
+
+        r->chunks[r->count++] = (struct replay_chunk) { .delay = (int) delay, .start = data_len, .len = len };
+        data_len += len;
+    }
+
+    free(line);
+    return 0;
+
+bad:
+    fprintf(stderr, "%s:%d: expected a delay in ms, a space and the keys\n", path, line_no);
+    free(line);
+    return -1;
+
+oom:
+    free(line);
+    return -1;
+}
+
+static int write_all(int fd, const char* data, int len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// true if it was told to stop in the meantime
+static bool sleep_ms(struct replay* r, int ms) {
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += ms / 1000;
+    until.tv_nsec += (long) (ms % 1000) * 1000000;
+    if (until.tv_nsec >= 1000000000) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&r->lock);
+    while (!r->stop && ms > 0) {
+        if (pthread_cond_timedwait(&r->wake, &r->lock, &until) == ETIMEDOUT) break;
+    }
+    bool stop = r->stop;
+    pthread_mutex_unlock(&r->lock);
+    return stop;
+}
+
+static void* feed(void* arg) {
+    struct replay* r = arg;
+
+    // an editor that quit before the script was over closes its end, that's an EPIPE here and not a signal
+    sigset_t pipe_signal;
+    sigemptyset(&pipe_signal);
+    sigaddset(&pipe_signal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_signal, NULL);
+
+    for (int i = 0; i < r->count; i++) {
+        struct replay_chunk* chunk = &r->chunks[i];
+        if (sleep_ms(r, chunk->delay)) break;
+        if (write_all(r->fd[1], r->data + chunk->start, chunk->len) != 0) break;
+    }
+
+    close(r->fd[1]); // and the editor sees the end of its input
+    return NULL;
+}
+
+int replay_open(struct replay* r, const char* path) {
+    r->data = NULL;
+    r->chunks = NULL;
+    r->count = 0;
+    r->thread_running = false;
+    r->stop = false;
+
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    int parsed = parse(r, f, path);
+    fclose(f);
+    if (parsed != 0 || pipe(r->fd) != 0) {
+        free(r->data);
+        free(r->chunks);
+        return -1;
+    }
+    fcntl(r->fd[0], F_SETFD, FD_CLOEXEC);
+    fcntl(r->fd[1], F_SETFD, FD_CLOEXEC);
+
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->wake, NULL);
+    r->thread_running = pthread_create(&r->thread, NULL, feed, r) == 0;
+    if (!r->thread_running) close(r->fd[1]); // no keys at all then, the editor just quits
+    return 0;
+}
+
+void replay_close(struct replay* r) {
+    pthread_mutex_lock(&r->lock);
+    r->stop = true;
+    pthread_cond_signal(&r->wake);
+    pthread_mutex_unlock(&r->lock);
+
+    close(r->fd[0]); // unblocks a write that's stuck on a full pipe
+    if (r->thread_running) pthread_join(r->thread, NULL);
+
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->wake);
+    free(r->data);
+    free(r->chunks);
+}
+
+int replay_fd(struct replay* r) {
+    return r->fd[0];
+}
+
+int record_open(struct recorder* rec, const char* path) {
+    rec->file = fopen(path, "w");
+    if (rec->file == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    rec->last = keys_now();
+    fputs("# recorded by vim-viperos -R, replay with -r\n", rec->file);
+    return 0;
+}
+
+void record_close(struct recorder* rec) {
+    if (rec->file != NULL) fclose(rec->file);
+    rec->file = NULL;
+}
+
+void record_input(struct recorder* rec, const char* data, int len) {
+    if (rec->file == NULL) return;
+
+    int64_t now = keys_now();
+    fprintf(rec->file, "%lld ", (long long) (now - rec->last));
+    rec->last = now;
+
+    for (int i = 0; i < len; i++) {
+        unsigned char c = data[i];
+        switch (c) {
+            case 0x1B: fputs("\\e", rec->file); break;
+            case '\r': fputs("\\r", rec->file); break;
+            case '\n': fputs("\\n", rec->file); break;
+            case '\t': fputs("\\t", rec->file); break;
+            case '\\': fputs("\\\\", rec->file); break;
+            default:
+                if (c < 0x20 || c >= 0x7F) fprintf(rec->file, "\\x%02x", c);
+                else fputc(c, rec->file);
+        }
+    }
+    fputc('\n', rec->file);
+}
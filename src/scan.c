@@ -0,0 +1,424 @@
+// Copyright 2025 JesusTouchMe
+
+#include "scan.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define SCAN_X86 1
+    #include <immintrin.h>
+#endif
+
+#if defined(SCAN_X86) && defined(__SSE2__)
+    #define SCAN_SSE2 1
+#endif
+
+// every kernel only takes whole blocks while a full block of hits still fits in out, the
+// generic tail finishes off whatever is left (less than a block, or until out fills up).
+// glibc memchr is vectorized too, but it stops at every hit and short lines make that cost a call per line
+
+static size_t scan_newlines_tail(const char* text, size_t size, size_t* pos, size_t* out, size_t n, size_t cap) {
+    size_t i = *pos;
+
+    while (n < cap) {
+        const char* nl = memchr(text + i, '\n', size - i);
+        if (nl == NULL) {
+            i = size;
+            break;
+        }
+
+        out[n++] = nl - text;
+        i = nl - text + 1;
+    }
+
+    *pos = i;
+    return n;
+}
+
+#ifdef SCAN_X86
+
+__attribute__((target("avx2")))
+static size_t scan_newlines_avx2(const char* text, size_t size, size_t* pos, size_t* out, size_t cap) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    size_t i = *pos;
+    size_t n = 0;
+
+    while (i + 32 <= size && n + 32 <= cap) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (text + i));
+        unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl));
+
+        while (mask != 0) {
+            out[n++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+
+        i += 32;
+    }
+
+    *pos = i;
+    return scan_newlines_tail(text, size, pos, out, n, cap);
+}
+
+#ifdef SCAN_SSE2
+
+static size_t scan_newlines_sse2(const char* text, size_t size, size_t* pos, size_t* out, size_t cap) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    size_t i = *pos;
+    size_t n = 0;
+
+    while (i + 16 <= size && n + 16 <= cap) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (text + i));
+        unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+
+        while (mask != 0) {
+            out[n++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+
+        i += 16;
+    }
+
+    *pos = i;
+    return scan_newlines_tail(text, size, pos, out, n, cap);
+}
+
+#endif
+
+static bool has_avx2(void) {
+    static int cached = -1;
+    if (cached < 0) {
+        __builtin_cpu_init();
+        cached = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return cached;
+}
+
+#endif
+
+size_t scan_newlines(const char* text, size_t size, size_t* pos, size_t* out, size_t cap) {
+#ifdef SCAN_X86
+    if (has_avx2()) return scan_newlines_avx2(text, size, pos, out, cap);
+#endif
+#ifdef SCAN_SSE2
+    return scan_newlines_sse2(text, size, pos, out, cap);
+#else
+    return scan_newlines_tail(text, size, pos, out, 0, cap);
+#endif
+}
+
+// substring search, the usual trick: compare a whole block of positions against the needle's first
+// and last byte at once and only memcmp where both match. the tails do the same one position at a time
+
+static const char* scan_find_tail(const char* text, size_t size, const char* needle, size_t len) {
+    const char* end = text + size - len + 1; // one past the last place a match can start
+
+    while (text < end) {
+        const char* hit = memchr(text, needle[0], end - text);
+        if (hit == NULL) return NULL;
+        if (memcmp(hit + 1, needle + 1, len - 1) == 0) return hit;
+        text = hit + 1;
+    }
+    return NULL;
+}
+
+static const char* scan_find_last_tail(const char* text, size_t size, const char* needle, size_t len) {
+    for (size_t i = size - len + 1; i-- > 0;) {
+        if (text[i] == needle[0] && memcmp(text + i + 1, needle + 1, len - 1) == 0) return text + i;
+    }
+    return NULL;
+}
+
+#ifdef SCAN_X86
+
+__attribute__((target("avx2")))
+static const char* scan_find_avx2(const char* text, size_t size, const char* needle, size_t len) {
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[len - 1]);
+    size_t i = 0;
+
+    while (i + len - 1 + 32 <= size) {
+        __m256i a = _mm256_loadu_si256((const __m256i*) (text + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*) (text + i + len - 1));
+        unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+
+        while (mask != 0) {
+            size_t at = i + __builtin_ctz(mask);
+            if (len <= 2 || memcmp(text + at + 1, needle + 1, len - 2) == 0) return text + at;
+            mask &= mask - 1;
+        }
+
+        i += 32;
+    }
+
+    return scan_find_tail(text + i, size - i, needle, len);
+}
+
+__attribute__((target("avx2")))
+static const char* scan_find_last_avx2(const char* text, size_t size, const char* needle, size_t len) {
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[len - 1]);
+    size_t end = size - len + 1; // positions [0, end) can start a match
+
+    while (end >= 32) {
+        size_t i = end - 32;
+        __m256i a = _mm256_loadu_si256((const __m256i*) (text + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*) (text + i + len - 1));
+        unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+
+        while (mask != 0) {
+            int bit = 31 - __builtin_clz(mask);
+            if (len <= 2 || memcmp(text + i + bit + 1, needle + 1, len - 2) == 0) return text + i + bit;
+            mask &= ~(1u << bit);
+        }
+
+        end = i;
+    }
+
+    return scan_find_last_tail(text, end + len - 1, needle, len);
+}
+
+#ifdef SCAN_SSE2
+
+static const char* scan_find_sse2(const char* text, size_t size, const char* needle, size_t len) {
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[len - 1]);
+    size_t i = 0;
+
+    while (i + len - 1 + 16 <= size) {
+        __m128i a = _mm_loadu_si128((const __m128i*) (text + i));
+        __m128i b = _mm_loadu_si128((const __m128i*) (text + i + len - 1));
+        unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+
+        while (mask != 0) {
+            size_t at = i + __builtin_ctz(mask);
+            if (len <= 2 || memcmp(text + at + 1, needle + 1, len - 2) == 0) return text + at;
+            mask &= mask - 1;
+        }
+
+        i += 16;
+    }
+
+    return scan_find_tail(text + i, size - i, needle, len);
+}
+
+static const char* scan_find_last_sse2(const char* text, size_t size, const char* needle, size_t len) {
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[len - 1]);
+    size_t end = size - len + 1;
+
+    while (end >= 16) {
+        size_t i = end - 16;
+        __m128i a = _mm_loadu_si128((const __m128i*) (text + i));
+        __m128i b = _mm_loadu_si128((const __m128i*) (text + i + len - 1));
+        unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+
+        while (mask != 0) {
+            int bit = 31 - __builtin_clz(mask);
+            if (len <= 2 || memcmp(text + i + bit + 1, needle + 1, len - 2) == 0) return text + i + bit;
+            mask &= ~(1u << bit);
+        }
+
+        end = i;
+    }
+
+    return scan_find_last_tail(text, end + len - 1, needle, len);
+}
+
+#endif
+
+#endif
+
+const char* scan_find(const char* text, size_t size, const char* needle, size_t len) {
+    if (len == 0) return text;
+    if (len > size) return NULL;
+    if (len == 1) return memchr(text, needle[0], size);
+
+#ifdef SCAN_X86
+    if (has_avx2()) return scan_find_avx2(text, size, needle, len);
+#endif
+#ifdef SCAN_SSE2
+    return scan_find_sse2(text, size, needle, len);
+#else
+    return scan_find_tail(text, size, needle, len);
+#endif
+}
+
+const char* scan_find_last(const char* text, size_t size, const char* needle, size_t len) {
+    if (len == 0) return text + size;
+    if (len > size) return NULL;
+
+#ifdef SCAN_X86
+    if (has_avx2()) return scan_find_last_avx2(text, size, needle, len);
+#endif
+#ifdef SCAN_SSE2
+    return scan_find_last_sse2(text, size, needle, len);
+#else
+    return scan_find_last_tail(text, size, needle, len);
+#endif
+}
+
+// plain ascii check. as signed bytes everything from 0x80 up is negative, so one less than 0x20
+// compare rules out the control chars and all of utf-8 at once, 0x7f is the only one left over
+
+static bool plain_byte(char c) {
+    return c >= 0x20 && c < 0x7F;
+}
+
+static size_t scan_plain_tail(const char* text, size_t size, size_t i) {
+    while (i < size && plain_byte(text[i])) i++;
+    return i;
+}
+
+#ifdef SCAN_X86
+
+__attribute__((target("avx2")))
+static size_t scan_plain_avx2(const char* text, size_t size) {
+    const __m256i low = _mm256_set1_epi8(0x20);
+    const __m256i del = _mm256_set1_epi8(0x7F);
+    size_t i = 0;
+
+    while (i + 32 <= size) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (text + i));
+        __m256i bad = _mm256_or_si256(_mm256_cmpgt_epi8(low, v), _mm256_cmpeq_epi8(v, del));
+        unsigned int mask = _mm256_movemask_epi8(bad);
+        if (mask != 0) return i + __builtin_ctz(mask);
+        i += 32;
+    }
+
+    return scan_plain_tail(text, size, i);
+}
+
+#ifdef SCAN_SSE2
+
+static size_t scan_plain_sse2(const char* text, size_t size) {
+    const __m128i low = _mm_set1_epi8(0x20);
+    const __m128i del = _mm_set1_epi8(0x7F);
+    size_t i = 0;
+
+    while (i + 16 <= size) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (text + i));
+        __m128i bad = _mm_or_si128(_mm_cmplt_epi8(v, low), _mm_cmpeq_epi8(v, del));
+        unsigned int mask = _mm_movemask_epi8(bad);
+        if (mask != 0) return i + __builtin_ctz(mask);
+        i += 16;
+    }
+
+    return scan_plain_tail(text, size, i);
+}
+
+#endif
+
+#endif
+
+size_t scan_plain(const char* text, size_t size) {
+#ifdef SCAN_X86
+    if (has_avx2()) return scan_plain_avx2(text, size);
+#endif
+#ifdef SCAN_SSE2
+    return scan_plain_sse2(text, size);
+#else
+    return scan_plain_tail(text, size, 0);
+#endif
+}
+
+// mismatch, both ends. a block of a and b compared byte by byte gives a mask with a bit per byte that's
+// the same, the first or last zero in it is the answer
+
+static size_t scan_mismatch_tail(const char* a, const char* b, size_t i, size_t size) {
+    while (i < size && a[i] == b[i]) i++;
+    return i;
+}
+
+static size_t scan_mismatch_last_tail(const char* a, const char* b, size_t end) {
+    while (end > 0 && a[end - 1] == b[end - 1]) end--;
+    return end;
+}
+
+#ifdef SCAN_X86
+
+__attribute__((target("avx2")))
+static size_t scan_mismatch_avx2(const char* a, const char* b, size_t size) {
+    size_t i = 0;
+
+    while (i + 32 <= size) {
+        __m256i va = _mm256_loadu_si256((const __m256i*) (a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i*) (b + i));
+        unsigned int differ = ~(unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+        if (differ != 0) return i + __builtin_ctz(differ);
+        i += 32;
+    }
+
+    return scan_mismatch_tail(a, b, i, size);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_mismatch_last_avx2(const char* a, const char* b, size_t size) {
+    size_t end = size;
+
+    while (end >= 32) {
+        __m256i va = _mm256_loadu_si256((const __m256i*) (a + end - 32));
+        __m256i vb = _mm256_loadu_si256((const __m256i*) (b + end - 32));
+        unsigned int differ = ~(unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+        if (differ != 0) return end - __builtin_clz(differ);
+        end -= 32;
+    }
+
+    return scan_mismatch_last_tail(a, b, end);
+}
+
+#ifdef SCAN_SSE2
+
+static size_t scan_mismatch_sse2(const char* a, const char* b, size_t size) {
+    size_t i = 0;
+
+    while (i + 16 <= size) {
+        __m128i va = _mm_loadu_si128((const __m128i*) (a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*) (b + i));
+        unsigned int differ = ~_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) & 0xFFFF;
+        if (differ != 0) return i + __builtin_ctz(differ);
+        i += 16;
+    }
+
+    return scan_mismatch_tail(a, b, i, size);
+}
+
+static size_t scan_mismatch_last_sse2(const char* a, const char* b, size_t size) {
+    size_t end = size;
+
+    while (end >= 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*) (a + end - 16));
+        __m128i vb = _mm_loadu_si128((const __m128i*) (b + end - 16));
+        unsigned int differ = ~_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) & 0xFFFF;
+        if (differ != 0) return end - 16 + 32 - __builtin_clz(differ);
+        end -= 16;
+    }
+
+    return scan_mismatch_last_tail(a, b, end);
+}
+
+#endif
+
+#endif
+
+size_t scan_mismatch(const void* a, const void* b, size_t size) {
+#ifdef SCAN_X86
+    if (has_avx2()) return scan_mismatch_avx2(a, b, size);
+#endif
+#ifdef SCAN_SSE2
+    return scan_mismatch_sse2(a, b, size);
+#else
+    return scan_mismatch_tail(a, b, 0, size);
+#endif
+}
+
+size_t scan_mismatch_last(const void* a, const void* b, size_t size) {
+#ifdef SCAN_X86
+    if (has_avx2()) return scan_mismatch_last_avx2(a, b, size);
+#endif
+#ifdef SCAN_SSE2
+    return scan_mismatch_last_sse2(a, b, size);
+#else
+    return scan_mismatch_last_tail(a, b, size);
+#endif
+}
@@ -0,0 +1,164 @@
+// Copyright 2025 JesusTouchMe
+
+#include "search.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+
+#define COUNT_CHUNK 1024 // lines counted per turn on the lock
+
+static long count_line(struct search* s, int line) {
+    long count = 0;
+    int col = fb_find(s->fb, line, s->pattern, s->len, 0, false);
+    while (col >= 0) {
+        count++;
+        col = fb_find(s->fb, line, s->pattern, s->len, col + 1, false);
+    }
+    return count;
+}
+
+// called with lock held. gives it to main in between chunks if it's waiting
+static void count_yield(struct search* s) {
+    if (!atomic_load(&s->main_waiting)) return;
+
+    pthread_mutex_unlock(&s->lock);
+    while (atomic_load(&s->main_waiting)) sched_yield(); // until main has it
+    pthread_mutex_lock(&s->lock);
+}
+
+static void* count_thread(void* arg) {
+    struct search* s = arg;
+    pthread_mutex_lock(&s->lock);
+
+    while (!s->quit) {
+        if (s->count >= 0 || s->len == 0) {
+            pthread_cond_wait(&s->wake, &s->lock);
+            continue;
+        }
+
+        unsigned long generation = s->generation;
+        unsigned long changes = s->fb->changes;
+        long total = 0;
+        int line = 0;
+
+        while (!s->quit && generation == s->generation && changes == s->fb->changes && line < s->fb->line_count) {
+            int end = line + COUNT_CHUNK < s->fb->line_count ? line + COUNT_CHUNK : s->fb->line_count;
+            for (; line < end; line++) total += count_line(s, line);
+            count_yield(s);
+        }
+
+        if (s->quit || generation != s->generation || changes != s->fb->changes) continue; // start over
+
+        s->count = total;
+        s->counted_changes = changes;
+        s->counted_lines = s->fb->line_count;
+
+        char c = 0;
+        write(s->notify[1], &c, 1);
+    }
+
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+int search_init(struct search* s, struct file_buffer* fb) {
+    s->len = 0;
+    s->backward = false;
+    s->fb = fb;
+    s->quit = false;
+    atomic_init(&s->main_waiting, false);
+    s->generation = 0;
+    s->counted_changes = 0;
+    s->counted_lines = 0;
+    s->count = 0;
+
+    if (pipe(s->notify) != 0) return -1;
+    for (int i = 0; i < 2; i++) {
+        fcntl(s->notify[i], F_SETFL, fcntl(s->notify[i], F_GETFL) | O_NONBLOCK);
+        fcntl(s->notify[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->wake, NULL);
+
+    if (pthread_create(&s->thread, NULL, count_thread, s) != 0) {
+        close(s->notify[0]);
+        close(s->notify[1]);
+        return -1;
+    }
+    return 0;
+}
+
+void search_destroy(struct search* s) {
+    pthread_mutex_lock(&s->lock);
+    s->quit = true;
+    pthread_cond_signal(&s->wake);
+    pthread_mutex_unlock(&s->lock);
+
+    pthread_join(s->thread, NULL);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->wake);
+    close(s->notify[0]);
+    close(s->notify[1]);
+}
+
+void search_lock(struct search* s) {
+    atomic_store(&s->main_waiting, true);
+    pthread_mutex_lock(&s->lock);
+    atomic_store(&s->main_waiting, false);
+}
+
+void search_unlock(struct search* s) {
+    // paged files also grow while they're being indexed
+    bool stale = s->counted_changes != s->fb->changes || s->counted_lines != s->fb->line_count;
+    if (s->len > 0 && s->count >= 0 && stale) {
+        s->count = -1;
+        pthread_cond_signal(&s->wake);
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+int search_fd(struct search* s) {
+    return s->notify[0];
+}
+
+void search_drain(struct search* s) {
+    char drain[64];
+    while (read(s->notify[0], drain, sizeof(drain)) > 0) {}
+}
+
+void search_set_pattern(struct search* s, const char* pattern, int len, bool backward) {
+    if (len > FB_FIND_MAX) len = FB_FIND_MAX;
+
+    memcpy(s->pattern, pattern, len);
+    s->len = len;
+    s->backward = backward;
+    s->generation++;
+    s->count = len > 0 ? -1 : 0;
+    pthread_cond_signal(&s->wake);
+}
+
+int search_find(struct search* s, int line, int col, bool backward, int* out_line, int* out_col) {
+    struct file_buffer* fb = s->fb;
+    if (s->len == 0) return -1;
+
+    // the cursor's line comes up twice, once for what's after the cursor and once after wrapping around
+    for (int i = 0; i <= fb->line_count; i++) {
+        int l = backward ? ((line - i) % fb->line_count + fb->line_count) % fb->line_count : (line + i) % fb->line_count;
+
+        int from;
+        if (!backward) from = i == 0 ? col + 1 : 0;
+        else from = i == 0 ? col : fb_line_length(fb, l) + 1;
+
+        int found = fb_find(fb, l, s->pattern, s->len, from, backward);
+        if (found >= 0) {
+            *out_line = l;
+            *out_col = found;
+            return 0;
+        }
+    }
+
+    return -1;
+}
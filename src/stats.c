@@ -0,0 +1,137 @@
+// Copyright 2025 JesusTouchMe
+
+#include "stats.h"
+
+#include <stdio.h>
+#include <time.h>
+
+static const char* const timer_names[STATS_TIMER_COUNT] = {
+    [STATS_FRAME] = "frame",
+    [STATS_LAYOUT] = "layout",
+    [STATS_DIFF] = "diff",
+    [STATS_WRITE] = "write",
+    [STATS_LOAD] = "load",
+    [STATS_SAVE] = "save",
+};
+
+static const char* const counter_names[STATS_COUNTER_COUNT] = {
+    [STATS_CELLS] = "cells",
+    [STATS_BYTES] = "bytes",
+    [STATS_WRITES] = "writes",
+};
+
+static struct stats_histogram g_timers[STATS_TIMER_COUNT];
+static uint64_t g_counters[STATS_COUNTER_COUNT];
+
+int64_t stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int bucket_of(uint64_t ns) {
+    uint64_t us = ns / 1000;
+    int bucket = us == 0 ? 0 : 64 - __builtin_clzll(us); // us < 2^bucket
+    return bucket < STATS_BUCKETS ? bucket : STATS_BUCKETS - 1;
+}
+
+void stats_time(enum stats_timer timer, int64_t start) {
+    int64_t ns = stats_now() - start;
+    if (ns < 0) ns = 0;
+
+    struct stats_histogram* h = &g_timers[timer];
+    h->count++;
+    h->total_ns += ns;
+    if ((uint64_t) ns > h->max_ns) h->max_ns = ns;
+    h->buckets[bucket_of(ns)]++;
+}
+
+void stats_count(enum stats_counter counter, uint64_t n) {
+    g_counters[counter] += n;
+}
+
+const struct stats_histogram* stats_histogram(enum stats_timer timer) {
+    return &g_timers[timer];
+}
+
+uint64_t stats_counter(enum stats_counter counter) {
+    return g_counters[counter];
+}
+
+int64_t stats_percentile(enum stats_timer timer, int percent) {
+    const struct stats_histogram* h = &g_timers[timer];
+    if (h->count == 0) return 0;
+
+    uint64_t want = (h->count * percent + 99) / 100; // the one that many in, counting from 1
+    if (want == 0) want = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < STATS_BUCKETS - 1; i++) {
+        seen += h->buckets[i];
+        if (seen >= want) {
+            int64_t top = (int64_t) 1000 << i;
+            return top < (int64_t) h->max_ns ? top : (int64_t) h->max_ns; // nothing took longer than the max
+        }
+    }
+    return h->max_ns;
+}
+
+// 850us, 12.3ms, 1.5s
+static void format_ns(char* out, int size, int64_t ns) {
+    if (ns < 1000000) snprintf(out, size, "%dus", (int) (ns / 1000));
+    else if (ns < 1000000000) snprintf(out, size, "%.1fms", ns / 1e6);
+    else snprintf(out, size, "%.1fs", ns / 1e9);
+}
+
+static int64_t mean_ns(enum stats_timer timer) {
+    const struct stats_histogram* h = &g_timers[timer];
+    return h->count > 0 ? (int64_t) (h->total_ns / h->count) : 0;
+}
+
+int stats_summary(char* out, int size) {
+    char p50[16], p99[16], max[16], layout[16], diff[16], load[16], save[16];
+    format_ns(p50, sizeof(p50), stats_percentile(STATS_FRAME, 50));
+    format_ns(p99, sizeof(p99), stats_percentile(STATS_FRAME, 99));
+    format_ns(max, sizeof(max), g_timers[STATS_FRAME].max_ns);
+    format_ns(layout, sizeof(layout), mean_ns(STATS_LAYOUT));
+    format_ns(diff, sizeof(diff), mean_ns(STATS_DIFF));
+    format_ns(load, sizeof(load), g_timers[STATS_LOAD].max_ns);
+    format_ns(save, sizeof(save), g_timers[STATS_SAVE].max_ns);
+
+    uint64_t frames = g_timers[STATS_FRAME].count;
+    double per_frame = frames > 0 ? 1.0 / frames : 0;
+
+    return snprintf(out, size, "%llu frames %s/%s/%s  layout %s diff %s  per frame %.0f cells %.0fB %.1f writes"
+                               "  load %s save %s",
+                    (unsigned long long) frames, p50, p99, max, layout, diff,
+                    g_counters[STATS_CELLS] * per_frame, g_counters[STATS_BYTES] * per_frame,
+                    g_counters[STATS_WRITES] * per_frame, load, save);
+}
+
+int stats_dump(const char* path) {
+    FILE* f = fopen(path, "w");
+    if (f == NULL) return -1;
+
+    fprintf(f, "{\n  \"timers\": {\n");
+    for (int t = 0; t < STATS_TIMER_COUNT; t++) {
+        const struct stats_histogram* h = &g_timers[t];
+        fprintf(f, "    \"%s\": {\"count\": %llu, \"total_ns\": %llu, \"max_ns\": %llu, \"p50_ns\": %lld, "
+                   "\"p90_ns\": %lld, \"p99_ns\": %lld, \"buckets\": [",
+                timer_names[t], (unsigned long long) h->count, (unsigned long long) h->total_ns,
+                (unsigned long long) h->max_ns, (long long) stats_percentile(t, 50),
+                (long long) stats_percentile(t, 90), (long long) stats_percentile(t, 99));
+
+        for (int i = 0; i < STATS_BUCKETS; i++) {
+            fprintf(f, "%s%llu", i > 0 ? ", " : "", (unsigned long long) h->buckets[i]);
+        }
+        fprintf(f, "]}%s\n", t + 1 < STATS_TIMER_COUNT ? "," : "");
+    }
+
+    fprintf(f, "  },\n  \"counters\": {");
+    for (int c = 0; c < STATS_COUNTER_COUNT; c++) {
+        fprintf(f, "%s\"%s\": %llu", c > 0 ? ", " : "", counter_names[c], (unsigned long long) g_counters[c]);
+    }
+    fprintf(f, "}\n}\n");
+
+    return fclose(f) == 0 ? 0 : -1;
+}
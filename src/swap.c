@@ -0,0 +1,288 @@
+// Copyright 2025 JesusTouchMe
+
+#include "swap.h"
+
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SWAP_MAGIC "vim-viperos swap"
+
+static char* swap_path_for(const char* path) {
+    const char* slash = strrchr(path, '/');
+    int dir_len = slash != NULL ? slash - path + 1 : 0;
+
+    size_t size = strlen(path) + 8;
+    char* swap_path = malloc(size);
+    if (swap_path == NULL) return NULL;
+
+    snprintf(swap_path, size, "%.*s.%s.swp", dir_len, path, path + dir_len);
+    return swap_path;
+}
+
+static void notify(struct swap* s) {
+    char c = 0;
+    write(s->notify[1], &c, 1);
+}
+
+static int write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// into a temp file that's renamed over the swap file, so there's always a whole one there. the snapshot
+// goes back to main as soon as it's written, the fsync doesn't need it
+static int write_swap(struct swap* s) {
+    size_t size = strlen(s->path) + 8;
+    char* tmp_path = malloc(size);
+    if (tmp_path == NULL) return -1;
+    snprintf(tmp_path, size, "%s.XXXXXX", s->path);
+
+    int fd = mkstemp(tmp_path);
+    if (fd < 0) {
+        free(tmp_path);
+        return -1;
+    }
+
+    char header[64];
+    int header_len = snprintf(header, sizeof(header), SWAP_MAGIC " %d\n", (int) getpid());
+    int written = write_all(fd, header, header_len) == 0 ? fb_snapshot_write(&s->snap, fd) : -1;
+
+    pthread_mutex_lock(&s->lock);
+    s->snap_done = true;
+    pthread_mutex_unlock(&s->lock);
+    notify(s);
+
+    if (written != 0 || fsync(fd) != 0 || rename(tmp_path, s->path) != 0) {
+        close(fd);
+        unlink(tmp_path);
+        free(tmp_path);
+        return -1;
+    }
+
+    close(fd);
+    free(tmp_path);
+    return 0;
+}
+
+static void* swap_thread(void* arg) {
+    struct swap* s = arg;
+    pthread_mutex_lock(&s->lock);
+
+    while (!s->quit) {
+        if (!s->busy) {
+            pthread_cond_wait(&s->wake, &s->lock);
+            continue;
+        }
+
+        pthread_mutex_unlock(&s->lock);
+        int result = write_swap(s);
+        pthread_mutex_lock(&s->lock);
+
+        s->busy = false;
+        s->failed = result != 0;
+        notify(s);
+    }
+
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+int swap_init(struct swap* s, struct file_buffer* fb) {
+    s->fb = fb;
+    s->path = NULL;
+    s->quit = false;
+    s->busy = false;
+    s->failed = false;
+    s->snap_out = false;
+    s->snap_done = false;
+    s->snap = (struct fb_snapshot) { .lines = NULL, .count = 0, .cap = 0, .text_end = NULL };
+    s->seen_changes = fb->changes;
+    s->pending_since = -1;
+    s->last_change = 0;
+    s->notify[0] = -1;
+    s->notify[1] = -1;
+
+    if (fb->paged != NULL) return 0;
+
+    s->path = swap_path_for(fb->path);
+    if (s->path == NULL) return -1;
+
+    if (pipe(s->notify) != 0) goto fail;
+    for (int i = 0; i < 2; i++) {
+        fcntl(s->notify[i], F_SETFL, fcntl(s->notify[i], F_GETFL) | O_NONBLOCK);
+        fcntl(s->notify[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->wake, NULL);
+
+    if (pthread_create(&s->thread, NULL, swap_thread, s) != 0) {
+        pthread_mutex_destroy(&s->lock);
+        pthread_cond_destroy(&s->wake);
+        close(s->notify[0]);
+        close(s->notify[1]);
+        goto fail;
+    }
+    return 0;
+
+fail:
+    free(s->path);
+    s->path = NULL;
+    return -1;
+}
+
+void swap_destroy(struct swap* s, bool keep) {
+    if (s->path == NULL) return;
+
+    pthread_mutex_lock(&s->lock);
+    s->quit = true;
+    pthread_cond_signal(&s->wake);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->thread, NULL);
+
+    if (s->snap_out) fb_snapshot_release(s->fb, &s->snap);
+    fb_snapshot_free(&s->snap);
+    if (!keep) unlink(s->path);
+
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->wake);
+    close(s->notify[0]);
+    close(s->notify[1]);
+    free(s->path);
+    s->path = NULL;
+}
+
+int swap_fd(struct swap* s) {
+    return s->notify[0];
+}
+
+int swap_timeout(struct swap* s, int64_t now) {
+    if (s->path == NULL || s->pending_since < 0 || s->snap_out) return -1; // swap_fd says when that's over
+
+    pthread_mutex_lock(&s->lock);
+    bool busy = s->busy;
+    pthread_mutex_unlock(&s->lock);
+    if (busy) return -1;
+
+    int64_t at = s->last_change + SWAP_IDLE;
+    if (s->pending_since + SWAP_MAX_WAIT < at) at = s->pending_since + SWAP_MAX_WAIT;
+    return at > now ? (int) (at - now) : 0;
+}
+
+void swap_tick(struct swap* s, int64_t now) {
+    if (s->path == NULL) return;
+
+    char drain[64];
+    while (read(s->notify[0], drain, sizeof(drain)) > 0) {}
+
+    pthread_mutex_lock(&s->lock);
+
+    if (s->snap_out && s->snap_done) {
+        fb_snapshot_release(s->fb, &s->snap);
+        s->snap_out = false;
+    }
+
+    if (s->failed) { // what it had is still missing, it gets another go after a while
+        s->failed = false;
+        s->last_change = now;
+        if (s->pending_since < 0) s->pending_since = now;
+    }
+
+    if (s->fb->changes != s->seen_changes) {
+        s->seen_changes = s->fb->changes;
+        s->last_change = now;
+        if (s->pending_since < 0) s->pending_since = now;
+    }
+
+    bool due = now - s->last_change >= SWAP_IDLE || now - s->pending_since >= SWAP_MAX_WAIT;
+    if (s->pending_since >= 0 && due && !s->busy && !s->snap_out && fb_snapshot_take(s->fb, &s->snap) == 0) {
+        s->snap_out = true;
+        s->snap_done = false;
+        s->busy = true;
+        s->pending_since = -1;
+        pthread_cond_signal(&s->wake);
+    }
+
+    pthread_mutex_unlock(&s->lock);
+}
+
+int swap_find(struct swap* s, struct swap_info* info) {
+    if (s->path == NULL) return -1;
+
+    FILE* f = fopen(s->path, "r");
+    if (f == NULL) return -1;
+
+    struct stat st;
+    int pid;
+    bool ok = fscanf(f, SWAP_MAGIC " %d", &pid) == 1 && fstat(fileno(f), &st) == 0;
+    fclose(f);
+    if (!ok) return -1;
+
+    info->pid = pid;
+    info->pid_alive = pid != getpid() && (kill(pid, 0) == 0 || errno == EPERM);
+    info->written = st.st_mtime;
+
+    struct stat file_st;
+    info->stale = stat(s->fb->path, &file_st) == 0 && file_st.st_mtime > st.st_mtime;
+    return 0;
+}
+
+int swap_recover(struct swap* s) {
+    FILE* f = fopen(s->path, "r");
+    if (f == NULL) return -1;
+
+    char* text = NULL;
+    size_t cap = 0;
+    size_t len = 0;
+    int pid;
+    if (fscanf(f, SWAP_MAGIC " %d", &pid) != 1 || fgetc(f) != '\n') goto fail;
+
+    while (1) {
+        if (len == cap) {
+            cap = cap == 0 ? 65536 : cap * 2;
+            char* tmp = realloc(text, cap);
+            if (tmp == NULL) goto fail;
+            text = tmp;
+        }
+
+        size_t n = fread(text + len, 1, cap - len, f);
+        len += n;
+        if (n == 0) break;
+    }
+    if (ferror(f)) goto fail;
+    fclose(f);
+
+    // every line ends in a newline there, the buffer doesn't have one after the last
+    if (len > 0 && text[len - 1] == '\n') len--;
+
+    struct file_buffer* fb = s->fb;
+    int result = fb_delete_lines(fb, 0, fb->line_count);
+    fb_set_cursor_pos(fb, 0, 0);
+    if (result == 0 && len > 0 && fb_insert_str(fb, 0, text, len) < 0) result = -1;
+
+    free(text);
+    return result;
+fail:
+    fclose(f);
+    free(text);
+    return -1;
+}
+
+void swap_discard(struct swap* s) {
+    if (s->path != NULL) unlink(s->path);
+}
@@ -1,45 +1,271 @@
 // Copyright 2025 JesusTouchMe
 
 #include "terminal.h"
+#include "stats.h"
 
 #include <sys/ioctl.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <termios.h>
 #include <unistd.h>
 
-static struct termios g_orig_term;
-static struct termios g_curr_term;
+#define OUT_INIT 16384
+
+static const struct term_backend* g_backend = &term_tty;
 static struct dimensions g_term_size;
 static void (*g_resize_handler)(void);
+static int g_input_fd = -1; // instead of the backend's, see term_set_input_fd
+
+// everything written goes in here until term_flush so a whole frame is one write
+static struct {
+    char* data;
+    size_t len;
+    size_t cap;
+} g_out;
+
+static void out_write_all(const char* data, size_t len) {
+    if (len == 0) return;
+    int64_t start = stats_now();
+    g_backend->write(data, len);
+    stats_time(STATS_WRITE, start);
+    stats_count(STATS_BYTES, len);
+}
+
+static void out_append(const char* data, size_t len) {
+    if (g_out.len + len > g_out.cap) {
+        size_t new_cap = g_out.cap == 0 ? OUT_INIT : g_out.cap;
+        while (new_cap < g_out.len + len) new_cap *= 2;
+
+        char* tmp = realloc(g_out.data, new_cap);
+        if (tmp == NULL) { // can't buffer it, get rid of what we have and write this one directly
+            term_flush();
+            out_write_all(data, len);
+            return;
+        }
+
+        g_out.data = tmp;
+        g_out.cap = new_cap;
+    }
+
+    memcpy(g_out.data + g_out.len, data, len);
+    g_out.len += len;
+}
+
+// the real terminal on stdin and stdout
+
+static struct termios g_orig_term;
+static struct termios g_curr_term;
+static int g_resize_pipe[2] = { -1, -1 }; // SIGWINCH just pokes this, the real work happens in term_handle_resize
 
-static void term_update_size(int sig) {
+static void tty_sigwinch(int sig) {
     (void) sig;
 
+    int saved_errno = errno;
+    write(g_resize_pipe[1], "", 1); // if the pipe is full there's a resize pending already
+    errno = saved_errno;
+}
+
+static void tty_init(void) {
+    tcgetattr(STDIN_FILENO, &g_orig_term);
+
+    if (pipe(g_resize_pipe) == 0) {
+        for (int i = 0; i < 2; i++) {
+            fcntl(g_resize_pipe[i], F_SETFL, fcntl(g_resize_pipe[i], F_GETFL) | O_NONBLOCK);
+            fcntl(g_resize_pipe[i], F_SETFD, FD_CLOEXEC);
+        }
+
+        signal(SIGWINCH, tty_sigwinch);
+    }
+
+    g_curr_term = g_orig_term;
+}
+
+static void tty_restore(void) {
+    tcsetattr(STDIN_FILENO, TCSANOW, &g_orig_term);
+}
+
+static void tty_set_raw(bool raw) {
+    if (raw) {
+        g_curr_term.c_lflag &= ~(ICANON | ECHO);
+        g_curr_term.c_cc[VMIN] = 1;
+        g_curr_term.c_cc[VTIME] = 0;
+    } else {
+        g_curr_term.c_lflag |= ICANON | ECHO;
+        g_curr_term.c_cc[VMIN] = g_orig_term.c_cc[VMIN];
+        g_curr_term.c_cc[VTIME] = g_orig_term.c_cc[VTIME];
+    }
+    tcsetattr(STDIN_FILENO, TCSANOW, &g_curr_term);
+}
+
+static void tty_write(const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(STDOUT_FILENO, data, len);
+        stats_count(STATS_WRITES, 1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return; // terminal's gone, nothing sensible left to do
+        }
+
+        data += n;
+        len -= n;
+    }
+}
+
+static bool tty_get_size(struct dimensions* size) {
     struct winsize ws = {0};
-    ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws);
-    g_term_size.width = ws.ws_col;
-    g_term_size.height = ws.ws_row;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0) return false;
+    size->width = ws.ws_col;
+    size->height = ws.ws_row;
+    return true;
+}
+
+static int tty_input_fd(void) {
+    return STDIN_FILENO;
+}
+
+const struct term_backend term_tty = {
+    .name = "tty",
+    .init = tty_init,
+    .restore = tty_restore,
+    .set_raw = tty_set_raw,
+    .write = tty_write,
+    .get_size = tty_get_size,
+    .input_fd = tty_input_fd,
+};
+
+// a terminal that only remembers what it was sent
+
+static struct {
+    char* data;
+    size_t len;
+    size_t cap;
+} g_captured;
+
+static void virtual_write(const char* data, size_t len) {
+    stats_count(STATS_WRITES, 1); // what it would have taken on a tty that keeps up
+    if (g_captured.len + len > g_captured.cap) {
+        size_t new_cap = g_captured.cap == 0 ? OUT_INIT : g_captured.cap;
+        while (new_cap < g_captured.len + len) new_cap *= 2;
+
+        char* tmp = realloc(g_captured.data, new_cap);
+        if (tmp == NULL) return; // it's only a capture, losing the end of it beats dying
+        g_captured.data = tmp;
+        g_captured.cap = new_cap;
+    }
+
+    memcpy(g_captured.data + g_captured.len, data, len);
+    g_captured.len += len;
+}
+
+static void virtual_restore(void) {
+    free(g_captured.data);
+    g_captured.data = NULL;
+    g_captured.len = 0;
+    g_captured.cap = 0;
+}
+
+static void nothing(void) {
+}
+
+static void nothing_raw(bool raw) {
+    (void) raw;
+}
+
+static bool no_size(struct dimensions* size) {
+    (void) size;
+    return false;
+}
+
+static int no_input(void) {
+    return -1;
+}
+
+const struct term_backend term_virtual = {
+    .name = "virtual",
+    .init = nothing,
+    .restore = virtual_restore,
+    .set_raw = nothing_raw,
+    .write = virtual_write,
+    .get_size = no_size,
+    .input_fd = no_input,
+};
+
+static void null_write(const char* data, size_t len) {
+    (void) data;
+    (void) len;
+    stats_count(STATS_WRITES, 1);
+}
+
+const struct term_backend term_null = {
+    .name = "null",
+    .init = nothing,
+    .restore = nothing,
+    .set_raw = nothing_raw,
+    .write = null_write,
+    .get_size = no_size,
+    .input_fd = no_input,
+};
+
+const struct term_backend* term_backend_named(const char* name) {
+    static const struct term_backend* backends[] = { &term_tty, &term_virtual, &term_null };
+    for (int i = 0; i < (int) (sizeof(backends) / sizeof(backends[0])); i++) {
+        if (strcmp(backends[i]->name, name) == 0) return backends[i];
+    }
+    return NULL;
+}
+
+void term_use(const struct term_backend* backend, struct dimensions size) {
+    g_backend = backend;
+    g_term_size = size;
+}
+
+const struct term_backend* term_backend(void) {
+    return g_backend;
+}
+
+static void term_update_size(void) {
+    struct dimensions size;
+    if (g_backend->get_size(&size)) g_term_size = size;
 
     if (g_resize_handler != NULL) g_resize_handler();
 }
 
 static void term_atexit(void) {
-    tcsetattr(STDIN_FILENO, TCSANOW, &g_orig_term);
+    term_flush();
+    free(g_out.data);
+    g_out.data = NULL;
+    g_out.cap = 0;
+
+    g_backend->restore();
 }
 
 void term_init(void) {
-    tcgetattr(STDIN_FILENO, &g_orig_term);
-    signal(SIGWINCH, term_update_size);
-
-    g_curr_term = g_orig_term;
-
+    g_backend->init();
     atexit(term_atexit);
 }
 
 void term_force_update_size(void) {
-    term_update_size(67);
+    term_update_size();
+}
+
+int term_resize_fd(void) {
+    return g_backend == &term_tty ? g_resize_pipe[0] : -1;
+}
+
+bool term_handle_resize(void) {
+    if (term_resize_fd() < 0) return false;
+
+    char drain[64];
+    bool resized = false;
+
+    while (read(g_resize_pipe[0], drain, sizeof(drain)) > 0) resized = true;
+
+    if (resized) term_update_size();
+    return resized;
 }
 
 struct dimensions term_get_size(void) {
@@ -50,47 +276,99 @@ void term_resize_handler(void (*cb)(void)) {
     g_resize_handler = cb;
 }
 
+int term_input_fd(void) {
+    return g_input_fd >= 0 ? g_input_fd : g_backend->input_fd();
+}
+
+void term_set_input_fd(int fd) {
+    g_input_fd = fd;
+}
+
+size_t term_bytes_written(void) {
+    return stats_counter(STATS_BYTES);
+}
+
+const char* term_captured(size_t* len) {
+    *len = g_captured.len;
+    return g_captured.data;
+}
+
 void term_enable_raw(void) {
-    g_curr_term.c_lflag &= ~(ICANON | ECHO);
-    g_curr_term.c_cc[VMIN] = 1;
-    g_curr_term.c_cc[VTIME] = 0;
-    tcsetattr(STDIN_FILENO, TCSANOW, &g_curr_term);
+    g_backend->set_raw(true);
+    out_append("\x1b[?2004h", 8);
 }
 
 void term_disable_raw(void) {
-    g_curr_term.c_lflag |= ICANON | ECHO;
-    g_curr_term.c_cc[VMIN] = g_orig_term.c_cc[VMIN];
-    g_curr_term.c_cc[VTIME] = g_orig_term.c_cc[VTIME];
-    tcsetattr(STDIN_FILENO, TCSANOW, &g_curr_term);
+    g_backend->set_raw(false);
+    out_append("\x1b[?2004l", 8);
+    term_flush();
 }
 
 void term_set_cursor_pos(int line, int col) {
     char seq[64];
     int n = snprintf(seq, sizeof(seq), "\x1b[%d;%dH", line, col);
-    write(STDOUT_FILENO, seq, n);
+    out_append(seq, n);
+}
+
+void term_cursor_forward(int n) {
+    char seq[32];
+    int len = snprintf(seq, sizeof(seq), "\x1b[%dC", n);
+    out_append(seq, len);
 }
 
 void term_clear(void) {
-    write(STDOUT_FILENO, "\x1b[2J", 4);
+    out_append("\x1b[2J", 4);
 }
 
 void term_move_home(void) {
-    write(STDOUT_FILENO, "\x1b[H", 3);
+    out_append("\x1b[H", 3);
+}
+
+void term_erase_line_end(void) {
+    out_append("\x1b[K", 3);
+}
+
+void term_erase_chars(int n) {
+    char seq[32];
+    int len = snprintf(seq, sizeof(seq), "\x1b[%dX", n);
+    out_append(seq, len);
+}
+
+void term_set_scroll_region(int top, int bottom) {
+    char seq[64];
+    int n = snprintf(seq, sizeof(seq), "\x1b[%d;%dr", top, bottom);
+    out_append(seq, n);
+}
+
+void term_reset_scroll_region(void) {
+    out_append("\x1b[r", 3);
+}
+
+void term_insert_lines(int n) {
+    char seq[32];
+    int len = snprintf(seq, sizeof(seq), "\x1b[%dL", n);
+    out_append(seq, len);
+}
+
+void term_delete_lines(int n) {
+    char seq[32];
+    int len = snprintf(seq, sizeof(seq), "\x1b[%dM", n);
+    out_append(seq, len);
 }
 
 void term_hide_cursor(void) {
-    write(STDOUT_FILENO, "\x1b[?25l", 6);
+    out_append("\x1b[?25l", 6);
 }
 
 void term_show_cursor(void) {
-    write(STDOUT_FILENO, "\x1b[?25h", 6);
+    out_append("\x1b[?25h", 6);
 }
 
 void term_fmt_reset(void) {
-    write(STDOUT_FILENO, "\x1b[0m", 4);
+    out_append("\x1b[0m", 4);
 }
 
-#define FMT_HELPER(enable, t, tl, f, fl) if (enable) write(STDOUT_FILENO, t, tl); else write(STDOUT_FILENO, f, fl);
+#define FMT_HELPER(enable, t, tl, f, fl) if (enable) out_append(t, tl); else out_append(f, fl);
 
 void term_fmt_bold(bool enable) {
     FMT_HELPER(enable, "\x1b[1m", 4, "\x1b[22m", 5);
@@ -121,23 +399,36 @@ void term_fmt_strikethrough(bool enable) {
 }
 
 void term_fmt_color_fg_reset(void) {
-    write(STDOUT_FILENO, "\x1b[39m", 5);
+    out_append("\x1b[39m", 5);
 }
 
 void term_fmt_color_bg_reset(void) {
-    write(STDOUT_FILENO, "\x1b[49m", 5);
+    out_append("\x1b[49m", 5);
 }
 
 void term_fmt_color_fg(struct color c) {
     char seq[64];
     int n = snprintf(seq, sizeof(seq), "\x1b[38;2;%u;%u;%um", (unsigned int) c.r, (unsigned int) c.g, (unsigned int) c.b);
-    write(STDOUT_FILENO, seq, n);
+    out_append(seq, n);
 }
 
 void term_fmt_color_bg(struct color c) {
     char seq[64];
     int n = snprintf(seq, sizeof(seq), "\x1b[48;2;%u;%u;%um", (unsigned int) c.r, (unsigned int) c.g, (unsigned int) c.b);
-    write(STDOUT_FILENO, seq, n);
+    out_append(seq, n);
+}
+
+void term_fmt_sgr(const int* params, int count) {
+    char seq[128];
+    int n = 2;
+    memcpy(seq, "\x1b[", 2);
+
+    for (int i = 0; i < count && n < (int) sizeof(seq) - 16; i++) {
+        n += snprintf(seq + n, sizeof(seq) - n, i == 0 ? "%d" : ";%d", params[i]);
+    }
+
+    seq[n++] = 'm';
+    out_append(seq, n);
 }
 
 void term_write(char c) {
@@ -145,5 +436,10 @@ void term_write(char c) {
 }
 
 void term_write_str(const char* str, int len) {
-    write(STDOUT_FILENO, str, len);
+    out_append(str, len);
+}
+
+void term_flush(void) {
+    out_write_all(g_out.data, g_out.len);
+    g_out.len = 0;
 }
@@ -1,74 +1,331 @@
 // Copyright 2025 JesusTouchMe
 
 #include "tui.h"
+#include "scan.h"
+#include "stats.h"
+#include "utf8.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-struct cell {
-    char c;
-    bool invert;
-};
+#define MAX_REWRITE_GAP 4 // cursor forward is 4+ bytes, a cursor position 6+
+#define MIN_ERASE_RUN 6
+
+#define CELL_CHAR_MASK ((uint64_t) 0x1FFFFF)
+#define CELL_CHAR(cell) ((uint32_t) ((cell) & CELL_CHAR_MASK))
+#define CELL_STYLE(cell) ((cell) & ~CELL_CHAR_MASK & ~CELL_CONT)
+
+// the right half of the wide char in the cell before it. it never gets written itself, the terminal
+// fills it in when the left half goes out
+#define CELL_CONT ((uint64_t) 1 << 21)
+
+#define STYLE_FG(style) ((tui_color) ((style) >> 32))
+#define STYLE_BG(style) ((tui_color) ((style) >> 48))
+
+// what can be seen on a space. a space with none of it is blank, and blanks are always stored as a
+// plain ' ' so comparing two cells never needs more than ==
+#define VISIBLE_ON_BLANK (TUI_UNDERLINE | TUI_INVERT | TUI_STRIKETHROUGH | TUI_BG(0xFFFF))
+
+#define RGB_BASE TUI_ANSI(256)
+#define RGB_HASH_SIZE (TUI_RGB_MAX * 2)
 
 struct screen {
     struct dimensions size;
-    struct cell* prev_cells;
-    struct cell* cells;
+    uint64_t* prev_cells;
+    uint64_t* cells;
+    bool* dirty; // rows written to since the last render, the others aren't even compared
 };
 
 struct screen g_screen;
 
+// what the terminal looks like as far as the renderer knows, so only actual changes get sent
+struct term_state {
+    int x, y; // cursor, -1 when unknown
+    tui_style style;
+};
+
+static struct term_state g_term;
+
+static struct color g_rgb[TUI_RGB_MAX];
+static int g_rgb_count;
+static uint16_t g_rgb_hash[RGB_HASH_SIZE]; // 1 + index into g_rgb, 0 if the slot is free
+
+struct sgr_attr {
+    tui_style bit;
+    int on;
+    int off;
+};
+
+// bold and faint both go off with 22, they're dealt with separately
+static const struct sgr_attr g_attrs[] = {
+    { TUI_ITALIC, 3, 23 },
+    { TUI_UNDERLINE, 4, 24 },
+    { TUI_BLINK, 5, 25 },
+    { TUI_INVERT, 7, 27 },
+    { TUI_STRIKETHROUGH, 9, 29 },
+};
+
+static uint64_t cell_make(uint32_t ch, tui_style style) {
+    if (ch == ' ' && (style & VISIBLE_ON_BLANK) == 0) return ' ';
+    return CELL_STYLE(style) | (ch & CELL_CHAR_MASK);
+}
+
 static void screen_reallocate(void) {
     free(g_screen.cells);
     free(g_screen.prev_cells);
-    size_t sz = g_screen.size.width * g_screen.size.height * sizeof(struct cell);
+    free(g_screen.dirty);
+    size_t sz = g_screen.size.width * g_screen.size.height * sizeof(uint64_t);
     g_screen.prev_cells = malloc(sz);
     g_screen.cells = malloc(sz);
-    if (g_screen.prev_cells == NULL || g_screen.cells == NULL) exit(1);
+    g_screen.dirty = malloc(g_screen.size.height * sizeof(bool));
+    if (g_screen.prev_cells == NULL || g_screen.cells == NULL || g_screen.dirty == NULL) exit(1);
     memset(g_screen.prev_cells, 0, sz);
     tui_clear();
 }
 
 static void screen_resize(void) {
     g_screen.size = term_get_size();
+    g_term.x = -1;
+    g_term.y = -1;
     screen_reallocate();
 }
 
-static bool cell_equal(struct cell* a, struct cell* b) {
-    return a->c == b->c && a->invert == b->invert;
+tui_color tui_rgb(struct color c) {
+    uint32_t key = ((uint32_t) c.r << 16) | ((uint32_t) c.g << 8) | c.b;
+    uint32_t slot = (key * 2654435761u) % RGB_HASH_SIZE;
+
+    while (g_rgb_hash[slot] != 0) {
+        int index = g_rgb_hash[slot] - 1;
+        if (g_rgb[index].r == c.r && g_rgb[index].g == c.g && g_rgb[index].b == c.b) return RGB_BASE + index;
+        slot = (slot + 1) % RGB_HASH_SIZE;
+    }
+
+    if (g_rgb_count == TUI_RGB_MAX) return TUI_DEFAULT;
+
+    g_rgb[g_rgb_count] = c;
+    g_rgb_hash[slot] = ++g_rgb_count;
+    return RGB_BASE + g_rgb_count - 1;
 }
 
-static void draw_cell(int x, int y, struct cell* cell) {
-    term_set_cursor_pos(y + 1, x + 1);
+static int color_params(int* out, tui_color color, bool bg) {
+    if (color == TUI_DEFAULT) {
+        out[0] = bg ? 49 : 39;
+        return 1;
+    }
+
+    if (color < RGB_BASE) {
+        int n = color - 1;
+        if (n < 8) {
+            out[0] = (bg ? 40 : 30) + n;
+            return 1;
+        }
+        if (n < 16) {
+            out[0] = (bg ? 100 : 90) + n - 8;
+            return 1;
+        }
+        out[0] = bg ? 48 : 38;
+        out[1] = 5;
+        out[2] = n;
+        return 3;
+    }
+
+    struct color c = g_rgb[color - RGB_BASE];
+    out[0] = bg ? 48 : 38;
+    out[1] = 2;
+    out[2] = c.r;
+    out[3] = c.g;
+    out[4] = c.b;
+    return 5;
+}
 
-    if (cell->invert) {
-        term_fmt_reverse(true);
-        term_write(cell->c);
-        term_fmt_reverse(false);
+// one sgr with only what changed, or a reset and everything the new style has if that's fewer
+static void emit_style(tui_style style) {
+    tui_style from = g_term.style;
+    if (from == style) return;
+
+    int diff[32];
+    int n = 0;
+    int fresh[32];
+    int m = 0;
+    fresh[m++] = 0;
+
+    tui_style intensity = TUI_BOLD | TUI_FAINT;
+    tui_style turned_on = style & ~from;
+    if (from & ~style & intensity) {
+        diff[n++] = 22;
+        turned_on |= style & intensity;
+    }
+    if (turned_on & TUI_BOLD) diff[n++] = 1;
+    if (turned_on & TUI_FAINT) diff[n++] = 2;
+    if (style & TUI_BOLD) fresh[m++] = 1;
+    if (style & TUI_FAINT) fresh[m++] = 2;
+
+    for (size_t i = 0; i < sizeof(g_attrs) / sizeof(g_attrs[0]); i++) {
+        const struct sgr_attr* attr = &g_attrs[i];
+        if ((from ^ style) & attr->bit) diff[n++] = style & attr->bit ? attr->on : attr->off;
+        if (style & attr->bit) fresh[m++] = attr->on;
+    }
+
+    if (STYLE_FG(from) != STYLE_FG(style)) n += color_params(diff + n, STYLE_FG(style), false);
+    if (STYLE_BG(from) != STYLE_BG(style)) n += color_params(diff + n, STYLE_BG(style), true);
+    if (STYLE_FG(style) != TUI_DEFAULT) m += color_params(fresh + m, STYLE_FG(style), false);
+    if (STYLE_BG(style) != TUI_DEFAULT) m += color_params(fresh + m, STYLE_BG(style), true);
+
+    if (m < n) term_fmt_sgr(fresh, m);
+    else term_fmt_sgr(diff, n);
+    g_term.style = style;
+}
+
+// the style a cell needs the terminal to be in. blanks take whatever is there as long as it doesn't show
+static tui_style needed_style(uint64_t cell) {
+    return cell == ' ' ? g_term.style & ~VISIBLE_ON_BLANK : CELL_STYLE(cell);
+}
+
+static void emit_char(uint32_t ch) {
+    char utf8[4];
+    term_write_str(utf8, utf8_encode(ch, utf8));
+}
+
+static bool cell_wide(uint64_t* row, int x) { // a wide char starts here
+    return x + 1 < g_screen.size.width && (row[x + 1] & CELL_CONT);
+}
+
+static void emit_move(int x, int y, uint64_t* row) {
+    if (g_term.x == x && g_term.y == y) return;
+
+    if (g_term.y == y && g_term.x >= 0 && g_term.x < x) {
+        int gap = x - g_term.x;
+
+        // a few unchanged cells in between are cheaper to just write again than a cursor move,
+        // as long as they don't need a style change
+        if (gap <= MAX_REWRITE_GAP) {
+            bool same_style = true;
+            for (int i = g_term.x; i < x; i++) {
+                if (needed_style(row[i]) != g_term.style || (row[i] & CELL_CONT) || cell_wide(row, i)) same_style = false;
+            }
+
+            if (same_style) {
+                for (int i = g_term.x; i < x; i++) emit_char(CELL_CHAR(row[i]));
+                g_term.x = x;
+                return;
+            }
+        }
+
+        term_cursor_forward(gap);
     } else {
-        term_write(cell->c);
+        term_set_cursor_pos(y + 1, x + 1);
+    }
+
+    g_term.x = x;
+    g_term.y = y;
+}
+
+// overwriting half of a wide char wipes out the other half too, so that one isn't known anymore
+static void clobber(uint64_t* prev, int x) {
+    if (cell_wide(prev, x)) prev[x + 1] = 0;
+}
+
+static void emit_cell(int x, int y, uint64_t* row, uint64_t* prev) {
+    int w = cell_wide(row, x) ? 2 : 1;
+
+    emit_move(x, y, row);
+    emit_style(needed_style(row[x]));
+    emit_char(CELL_CHAR(row[x]));
+
+    clobber(prev, x);
+    if (w == 2) clobber(prev, x + 1);
+    for (int i = x; i < x + w; i++) prev[i] = row[i];
+
+    // writing the last column leaves the cursor in the pending wrap state, don't guess about that
+    g_term.x = x + w < g_screen.size.width ? x + w : -1;
+}
+
+// returns how many cells it sent
+static int render_row(int y) {
+    int width = g_screen.size.width;
+    uint64_t* row = &g_screen.cells[y * width];
+    uint64_t* prev = &g_screen.prev_cells[y * width];
+    int sent = 0;
+
+    // only what's between the first and last cell that changed needs looking at. one before that too, the
+    // right half of a wide char changing is handled from its left half
+    size_t row_size = width * sizeof(uint64_t);
+    int first = scan_mismatch(row, prev, row_size) / sizeof(uint64_t);
+    if (first == width) return 0;
+    int last = (scan_mismatch_last(row, prev, row_size) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    if (first > 0) first--;
+
+    int blank_from = width;
+    while (blank_from > 0 && row[blank_from - 1] == ' ') blank_from--;
+
+    for (int x = first; x < last; x++) {
+        if (row[x] & CELL_CONT) continue; // goes out with its left half
+        if (row[x] == prev[x] && (!cell_wide(row, x) || row[x + 1] == prev[x + 1])) continue;
+
+        if (x >= blank_from) { // nothing but blanks left on this row
+            emit_move(x, y, row);
+            emit_style(g_term.style & ~VISIBLE_ON_BLANK); // erasing fills with the background
+            term_erase_line_end();
+            memcpy(&prev[x], &row[x], (width - x) * sizeof(uint64_t));
+            return sent + width - x;
+        }
+
+        if (row[x] == ' ') {
+            int run = 0;
+            int changed = 0;
+            while (x + run < blank_from && row[x + run] == ' ') {
+                if (prev[x + run] != ' ') changed++;
+                run++;
+            }
+
+            if (changed >= MIN_ERASE_RUN) {
+                emit_move(x, y, row);
+                emit_style(g_term.style & ~VISIBLE_ON_BLANK);
+                term_erase_chars(run); // doesn't move the cursor
+                clobber(prev, x + run - 1);
+                memcpy(&prev[x], &row[x], run * sizeof(uint64_t));
+                sent += changed;
+                x += run - 1;
+                continue;
+            }
+        }
+
+        emit_cell(x, y, row, prev);
+        sent++;
+        if (cell_wide(row, x)) x++;
     }
+
+    return sent;
 }
 
 void tui_init(void) {
     term_hide_cursor();
+    term_fmt_reset();
+    g_term.x = -1;
+    g_term.y = -1;
+    g_term.style = 0;
+
     term_force_update_size();
     g_screen.size = term_get_size();
     g_screen.prev_cells = NULL;
     g_screen.cells = NULL;
+    g_screen.dirty = NULL;
     screen_reallocate();
 
     term_resize_handler(screen_resize);
 }
 
 void tui_destroy(void) {
+    term_fmt_reset();
     term_show_cursor();
     term_clear();
     free(g_screen.prev_cells);
     free(g_screen.cells);
+    free(g_screen.dirty);
 
     term_write('\n');
+    term_flush();
 }
 
 struct dimensions tui_get_screen_size(void) {
@@ -76,32 +333,130 @@ struct dimensions tui_get_screen_size(void) {
 }
 
 void tui_clear(void) {
-    for (int i = 0; i < g_screen.size.width * g_screen.size.height; i++) {
-        g_screen.cells[i].c = ' ';
-        g_screen.cells[i].invert = false;
+    tui_clear_rows(0, g_screen.size.height);
+}
+
+void tui_clear_rows(int from, int to) {
+    if (from < 0) from = 0;
+    if (to > g_screen.size.height) to = g_screen.size.height;
+
+    for (int y = from; y < to; y++) {
+        uint64_t* row = &g_screen.cells[y * g_screen.size.width];
+        for (int x = 0; x < g_screen.size.width; x++) row[x] = ' ';
+        g_screen.dirty[y] = true;
+    }
+}
+
+void tui_scroll(int from, int to, int n) {
+    if (from < 0) from = 0;
+    if (to > g_screen.size.height) to = g_screen.size.height;
+    int height = to - from;
+    if (n == 0 || height <= 0) return;
+
+    int shift = n > 0 ? n : -n;
+    if (shift >= height) { // nothing that's there now stays on screen
+        tui_clear_rows(from, to);
+        return;
+    }
+
+    // the lines that come in get the background that's set, like an erase
+    emit_style(g_term.style & ~VISIBLE_ON_BLANK);
+    term_set_scroll_region(from + 1, to);
+    term_set_cursor_pos(from + 1, 1);
+    if (n > 0) term_delete_lines(n);
+    else term_insert_lines(shift);
+    term_reset_scroll_region();
+    g_term.x = -1;
+    g_term.y = -1;
+
+    // the terminal moved what it had, so do the same to what it's known to have and to what's drawn on top
+    int width = g_screen.size.width;
+    int kept = height - shift;
+    int src = n > 0 ? from + shift : from;
+    int dst = n > 0 ? from : from + shift;
+    memmove(&g_screen.prev_cells[dst * width], &g_screen.prev_cells[src * width], kept * width * sizeof(uint64_t));
+    memmove(&g_screen.cells[dst * width], &g_screen.cells[src * width], kept * width * sizeof(uint64_t));
+    memmove(&g_screen.dirty[dst], &g_screen.dirty[src], kept * sizeof(bool));
+
+    int exposed = n > 0 ? to - shift : from;
+    for (int i = exposed * width; i < (exposed + shift) * width; i++) g_screen.prev_cells[i] = ' ';
+    tui_clear_rows(exposed, exposed + shift);
+}
+
+bool tui_row_dirty(int y) {
+    return y >= 0 && y < g_screen.size.height && g_screen.dirty[y];
+}
+
+static uint64_t* cell_at(int x, int y) {
+    if (x < 0 || x >= g_screen.size.width || y < 0 || y >= g_screen.size.height) return NULL;
+    return &g_screen.cells[y * g_screen.size.width + x];
+}
+
+// a wide char loses its other half when either of its cells gets something else
+static void unpair(int x, int y) {
+    uint64_t* row = &g_screen.cells[y * g_screen.size.width];
+    if (row[x] & CELL_CONT) row[x - 1] = cell_make(' ', CELL_STYLE(row[x - 1]));
+    else if (cell_wide(row, x)) row[x + 1] = cell_make(' ', CELL_STYLE(row[x + 1]));
+}
+
+static void put(int x, int y, uint32_t ch, tui_style style) {
+    uint64_t* cell = cell_at(x, y);
+    if (cell == NULL) return;
+    g_screen.dirty[y] = true;
+
+    if (ch < 0x20 || (ch >= 0x7F && ch < 0xA0)) ch = '?'; // never send a control char by accident
+
+    int w = utf8_width(ch);
+    if (w == 0) return; // a combining mark has no cell of its own
+
+    unpair(x, y);
+    if (w == 2 && x + 1 >= g_screen.size.width) { // cut off by the edge
+        *cell = cell_make(' ', style);
+        return;
+    }
+
+    *cell = cell_make(ch, style);
+    if (w == 2) {
+        unpair(x + 1, y);
+        cell[1] = CELL_CONT | CELL_STYLE(style);
     }
 }
 
 void tui_put(int x, int y, char c) {
-    if (x >= 0 && x < g_screen.size.width && y >= 0 && y < g_screen.size.height)
-        g_screen.cells[y * g_screen.size.width + x].c = c;
+    uint64_t* cell = cell_at(x, y);
+    if (cell != NULL) put(x, y, (unsigned char) c, CELL_STYLE(*cell));
+}
+
+void tui_put_styled(int x, int y, uint32_t ch, tui_style style) {
+    put(x, y, ch, style);
 }
 
 void tui_set_invert(int x, int y, bool invert) {
-    if (x >= 0 && x < g_screen.size.width && y >= 0 && y < g_screen.size.height)
-        g_screen.cells[y * g_screen.size.width + x].invert = invert;
+    uint64_t* cell = cell_at(x, y);
+    if (cell == NULL) return;
+    g_screen.dirty[y] = true;
+
+    // both halves of a wide char, whichever one this is
+    uint64_t* row = &g_screen.cells[y * g_screen.size.width];
+    if (*cell & CELL_CONT) x--;
+    int w = cell_wide(row, x) ? 2 : 1;
+
+    for (int i = x; i < x + w; i++) {
+        tui_style style = invert ? CELL_STYLE(row[i]) | TUI_INVERT : CELL_STYLE(row[i]) & ~TUI_INVERT;
+        row[i] = (row[i] & CELL_CONT) ? CELL_CONT | style : cell_make(CELL_CHAR(row[i]), style);
+    }
 }
 
 void tui_render(void) {
-    term_move_home();
-
+    int64_t start = stats_now();
+    int sent = 0;
     for (int y = 0; y < g_screen.size.height; y++) {
-        for (int x = 0; x < g_screen.size.width; x++) {
-            int i = y * g_screen.size.width + x;
-            if (!cell_equal(&g_screen.cells[i], &g_screen.prev_cells[i])) {
-                draw_cell(x, y, &g_screen.cells[i]);
-                g_screen.prev_cells[i] = g_screen.cells[i];
-            }
-        }
+        if (!g_screen.dirty[y]) continue;
+        sent += render_row(y);
+        g_screen.dirty[y] = false;
     }
+    stats_time(STATS_DIFF, start);
+    stats_count(STATS_CELLS, sent);
+
+    term_flush();
 }
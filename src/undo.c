@@ -0,0 +1,339 @@
+// Copyright 2025 JesusTouchMe
+
+#include "undo.h"
+#include "filebuf.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum undo_type {
+    UNDO_INSERT, // text was inserted at line:col
+    UNDO_DELETE, // text was deleted from line:col
+    UNDO_SPLIT, // line was split at col
+    UNDO_JOIN, // line + 1 was appended to line, which was col long
+    UNDO_DELETE_LINES, // col lines starting at line, payload is each one's length and text
+    UNDO_DELETE_ALL_LINES, // same, but it left an empty line behind
+    UNDO_INSERT_LINE, // a new line went in at line, payload is its text
+};
+
+// in the arena a record is this header, len bytes of payload and then the size of the whole
+// record again, so it can be walked backwards too
+struct undo_record {
+    uint8_t type;
+    uint32_t group;
+    int32_t line;
+    int32_t col;
+    int32_t len;
+};
+
+#define RECORD_OVERHEAD (sizeof(struct undo_record) + sizeof(uint32_t))
+
+void undo_init(struct undo_journal* j, size_t max) {
+    j->data = NULL;
+    j->len = 0;
+    j->cap = 0;
+    j->top = 0;
+    j->max = max;
+    j->group = 0;
+}
+
+void undo_free(struct undo_journal* j) {
+    free(j->data);
+    undo_init(j, j->max);
+}
+
+static int reserve(struct undo_journal* j, size_t extra) {
+    if (j->len + extra <= j->cap) return 0;
+
+    size_t new_cap = j->cap == 0 ? 4096 : j->cap;
+    while (new_cap < j->len + extra) new_cap *= 2;
+
+    char* tmp = realloc(j->data, new_cap);
+    if (tmp == NULL) return -1;
+
+    j->data = tmp;
+    j->cap = new_cap;
+    return 0;
+}
+
+static void read_header(struct undo_journal* j, size_t offset, struct undo_record* rec) {
+    memcpy(rec, j->data + offset, sizeof(struct undo_record));
+}
+
+static size_t record_before(struct undo_journal* j, size_t offset) {
+    uint32_t size;
+    memcpy(&size, j->data + offset - sizeof(uint32_t), sizeof(uint32_t));
+    return offset - size;
+}
+
+// drops whole groups off the front until the arena is comfortably under the limit again. never the one
+// still being recorded, undoing only the end of that would leave the edit half done. the arena stays over
+// the limit until it's closed and the next undo_begin trims it. nothing that can be redone goes either
+static void trim(struct undo_journal* j) {
+    if (j->len <= j->max) return;
+
+    size_t cut = 0;
+    while (cut < j->top && j->len - cut > j->max / 4 * 3) {
+        struct undo_record rec;
+        read_header(j, cut, &rec);
+        if (rec.group == j->group) break;
+
+        uint32_t group = rec.group;
+        while (cut < j->top) {
+            read_header(j, cut, &rec);
+            if (rec.group != group) break;
+            cut += RECORD_OVERHEAD + rec.len;
+        }
+    }
+
+    memmove(j->data, j->data + cut, j->len - cut);
+    j->len -= cut;
+    j->top -= cut;
+}
+
+void undo_begin(struct undo_journal* j) {
+    j->group++;
+    trim(j); // the group before is closed now, it can go if it has to
+}
+
+// the record being built always sits at the end of the arena, without its trailing size until it's done
+static int record_start(struct undo_journal* j, enum undo_type type, int line, int col) {
+    j->len = j->top; // anything that could have been redone is gone now
+    if (reserve(j, RECORD_OVERHEAD) != 0) return -1;
+
+    struct undo_record rec = { .type = type, .group = j->group, .line = line, .col = col, .len = 0 };
+    memcpy(j->data + j->len, &rec, sizeof(rec));
+    j->len += sizeof(rec);
+    return 0;
+}
+
+static int record_append(struct undo_journal* j, size_t header, const void* data, size_t size) {
+    if (reserve(j, size + sizeof(uint32_t)) != 0) return -1;
+
+    memcpy(j->data + j->len, data, size);
+    j->len += size;
+
+    struct undo_record rec;
+    read_header(j, header, &rec);
+    rec.len += size;
+    memcpy(j->data + header, &rec, sizeof(rec));
+    return 0;
+}
+
+static void record_finish(struct undo_journal* j, size_t header) {
+    uint32_t size = j->len + sizeof(uint32_t) - header;
+    memcpy(j->data + j->len, &size, sizeof(size)); // record_append and record_start reserved this
+    j->len += sizeof(size);
+    j->top = j->len;
+    trim(j);
+}
+
+// reopens the last record if text can just be added on to it
+static int extend_last(struct undo_journal* j, enum undo_type type, int line, int col, const char* text, int len) {
+    if (j->top == 0 || j->top != j->len) return -1;
+
+    size_t header = record_before(j, j->top);
+    struct undo_record rec;
+    read_header(j, header, &rec);
+
+    if (rec.type != type || rec.group != j->group || rec.line != line) return -1;
+    if (type == UNDO_INSERT && rec.col + rec.len != col) return -1;
+    if (type == UNDO_DELETE && rec.col != col) return -1; // deleting forward from the same spot
+
+    j->len -= sizeof(uint32_t);
+    j->top = j->len;
+    if (record_append(j, header, text, len) != 0) {
+        j->len += sizeof(uint32_t); // the trailing size is still there, just put it back
+        j->top = j->len;
+        return 0;
+    }
+    record_finish(j, header);
+    return 0;
+}
+
+static void record_text(struct undo_journal* j, enum undo_type type, int line, int col, const char* text, int len) {
+    if (extend_last(j, type, line, col, text, len) == 0) return;
+
+    size_t header = j->top;
+    if (record_start(j, type, line, col) != 0) return;
+    if (record_append(j, header, text, len) != 0) {
+        j->len = header;
+        return;
+    }
+    record_finish(j, header);
+}
+
+void undo_record_insert(struct undo_journal* j, int line, int col, char c) {
+    record_text(j, UNDO_INSERT, line, col, &c, 1);
+}
+
+void undo_record_insert_str(struct undo_journal* j, int line, int col, const char* text, int len) {
+    record_text(j, UNDO_INSERT, line, col, text, len);
+}
+
+void undo_record_delete(struct undo_journal* j, int line, int col, char c) {
+    record_text(j, UNDO_DELETE, line, col, &c, 1);
+}
+
+void undo_record_delete_str(struct undo_journal* j, int line, int col, const char* text, int len) {
+    record_text(j, UNDO_DELETE, line, col, text, len);
+}
+
+static void record_simple(struct undo_journal* j, enum undo_type type, int line, int col) {
+    size_t header = j->top;
+    if (record_start(j, type, line, col) != 0) return;
+    record_finish(j, header);
+}
+
+void undo_record_split(struct undo_journal* j, int line, int col) {
+    record_simple(j, UNDO_SPLIT, line, col);
+}
+
+void undo_record_join(struct undo_journal* j, int line, int col) {
+    record_simple(j, UNDO_JOIN, line, col);
+}
+
+void undo_record_delete_lines(struct undo_journal* j, struct file_buffer* fb, int line, int count, int placeholder) {
+    size_t header = j->top;
+    if (record_start(j, placeholder ? UNDO_DELETE_ALL_LINES : UNDO_DELETE_LINES, line, count) != 0) return;
+
+    char chunk[256];
+    for (int i = 0; i < count; i++) {
+        int32_t len = fb_line_length(fb, line + i);
+        if (record_append(j, header, &len, sizeof(len)) != 0) goto fail;
+
+        for (int c = 0; c < len; c += sizeof(chunk)) {
+            int n = len - c < (int) sizeof(chunk) ? len - c : (int) sizeof(chunk);
+            for (int k = 0; k < n; k++) chunk[k] = fb_char_at(fb, line + i, c + k);
+            if (record_append(j, header, chunk, n) != 0) goto fail;
+        }
+    }
+
+    record_finish(j, header);
+    return;
+
+    fail:
+    j->len = header;
+    j->top = header;
+}
+
+void undo_record_insert_line(struct undo_journal* j, int line, const char* text, int len) {
+    size_t header = j->top;
+    if (record_start(j, UNDO_INSERT_LINE, line, 0) != 0) return;
+    if (record_append(j, header, text, len) != 0) {
+        j->len = header;
+        return;
+    }
+    record_finish(j, header);
+}
+
+// records never hold a newline, those are splits, so these stay on the one line
+static void insert_text(struct file_buffer* fb, int line, int col, const char* text, int len) {
+    fb_set_cursor_pos(fb, line, col);
+    fb_insert_str(fb, line, text, len);
+}
+
+static void delete_text(struct file_buffer* fb, int line, int col, int len) {
+    fb_set_cursor_pos(fb, line, col);
+    fb_delete_chars(fb, line, len);
+}
+
+static void restore_lines(struct file_buffer* fb, const struct undo_record* rec, const char* payload) {
+    for (int i = 0; i < rec->col; i++) {
+        int32_t len;
+        memcpy(&len, payload, sizeof(len));
+        payload += sizeof(len);
+
+        fb_insert_line(fb, rec->line + i, payload, len);
+        payload += len;
+    }
+
+    if (rec->type == UNDO_DELETE_ALL_LINES) fb_delete_lines(fb, rec->col, 1);
+}
+
+static void apply(struct undo_journal* j, struct file_buffer* fb, size_t offset, bool inverse, int* line, int* col) {
+    struct undo_record rec;
+    read_header(j, offset, &rec);
+    const char* payload = j->data + offset + sizeof(rec);
+
+    *line = rec.line;
+    *col = rec.col;
+
+    switch (rec.type) {
+        case UNDO_INSERT:
+            if (inverse) delete_text(fb, rec.line, rec.col, rec.len);
+            else insert_text(fb, rec.line, rec.col, payload, rec.len);
+            if (!inverse) *col += rec.len;
+            break;
+        case UNDO_DELETE:
+            if (inverse) insert_text(fb, rec.line, rec.col, payload, rec.len);
+            else delete_text(fb, rec.line, rec.col, rec.len);
+            break;
+        case UNDO_SPLIT:
+            if (inverse) fb_join_lines(fb, rec.line);
+            else fb_split_line(fb, rec.line, rec.col);
+            break;
+        case UNDO_JOIN:
+            if (inverse) fb_split_line(fb, rec.line, rec.col);
+            else fb_join_lines(fb, rec.line);
+            break;
+        case UNDO_DELETE_LINES:
+        case UNDO_DELETE_ALL_LINES:
+            if (inverse) restore_lines(fb, &rec, payload);
+            else fb_delete_lines(fb, rec.line, rec.col);
+            *col = 0;
+            break;
+        case UNDO_INSERT_LINE:
+            if (inverse) fb_delete_lines(fb, rec.line, 1);
+            else fb_insert_line(fb, rec.line, payload, rec.len);
+            break;
+    }
+}
+
+int undo_undo(struct undo_journal* j, struct file_buffer* fb, int* line, int* col) {
+    if (j->top == 0) return -1;
+
+    struct undo_journal* attached = fb->undo;
+    fb->undo = NULL; // undoing shouldn't be recorded as new changes
+
+    struct undo_record rec;
+    read_header(j, record_before(j, j->top), &rec);
+    uint32_t group = rec.group;
+
+    while (j->top > 0) {
+        size_t offset = record_before(j, j->top);
+        read_header(j, offset, &rec);
+        if (rec.group != group) break;
+
+        apply(j, fb, offset, true, line, col);
+        j->top = offset;
+    }
+
+    fb->undo = attached;
+    undo_begin(j); // typing after an undo must never extend a record from before it
+    return 0;
+}
+
+int undo_redo(struct undo_journal* j, struct file_buffer* fb, int* line, int* col) {
+    if (j->top == j->len) return -1;
+
+    struct undo_journal* attached = fb->undo;
+    fb->undo = NULL;
+
+    struct undo_record rec;
+    read_header(j, j->top, &rec);
+    uint32_t group = rec.group;
+
+    while (j->top < j->len) {
+        read_header(j, j->top, &rec);
+        if (rec.group != group) break;
+
+        apply(j, fb, j->top, false, line, col);
+        j->top += RECORD_OVERHEAD + rec.len;
+    }
+
+    fb->undo = attached;
+    undo_begin(j);
+    return 0;
+}
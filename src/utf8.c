@@ -0,0 +1,189 @@
+// Copyright 2025 JesusTouchMe
+
+#include "utf8.h"
+#include "scan.h"
+
+#include <string.h>
+
+struct range {
+    uint32_t first;
+    uint32_t last;
+};
+
+// combining marks and other things that don't take up a column of their own
+static const struct range g_zero_width[] = {
+    { 0x0300, 0x036F }, { 0x0483, 0x0489 }, { 0x0591, 0x05BD }, { 0x0610, 0x061A }, { 0x064B, 0x065F },
+    { 0x0E31, 0x0E31 }, { 0x0E34, 0x0E3A }, { 0x0E47, 0x0E4E }, { 0x1AB0, 0x1AFF }, { 0x1DC0, 0x1DFF },
+    { 0x200B, 0x200F }, { 0x202A, 0x202E }, { 0x2060, 0x2064 }, { 0x20D0, 0x20FF }, { 0xFE00, 0xFE0F },
+    { 0xFE20, 0xFE2F }, { 0xFEFF, 0xFEFF }, { 0xE0100, 0xE01EF },
+};
+
+// east asian wide and fullwidth, and the emoji blocks
+static const struct range g_wide[] = {
+    { 0x1100, 0x115F }, { 0x231A, 0x231B }, { 0x2329, 0x232A }, { 0x23E9, 0x23EC }, { 0x25FD, 0x25FE },
+    { 0x2614, 0x2615 }, { 0x2648, 0x2653 }, { 0x26AA, 0x26AB }, { 0x26BD, 0x26BE }, { 0x26F5, 0x26F5 },
+    { 0x2705, 0x2705 }, { 0x270A, 0x270B }, { 0x2728, 0x2728 }, { 0x274C, 0x274C }, { 0x2753, 0x2755 },
+    { 0x2795, 0x2797 }, { 0x2B1B, 0x2B1C }, { 0x2E80, 0x303E }, { 0x3041, 0x33FF }, { 0x3400, 0x4DBF },
+    { 0x4E00, 0x9FFF }, { 0xA000, 0xA4CF }, { 0xA960, 0xA97F }, { 0xAC00, 0xD7A3 }, { 0xF900, 0xFAFF },
+    { 0xFE10, 0xFE19 }, { 0xFE30, 0xFE6F }, { 0xFF00, 0xFF60 }, { 0xFFE0, 0xFFE6 }, { 0x16FE0, 0x16FE4 },
+    { 0x17000, 0x18CFF }, { 0x1B000, 0x1B2FF }, { 0x1F004, 0x1F004 }, { 0x1F0CF, 0x1F0CF }, { 0x1F18E, 0x1F18E },
+    { 0x1F191, 0x1F19A }, { 0x1F200, 0x1F251 }, { 0x1F300, 0x1F64F }, { 0x1F680, 0x1F6FF }, { 0x1F7E0, 0x1F7EB },
+    { 0x1F900, 0x1F9FF }, { 0x1FA70, 0x1FAFF }, { 0x20000, 0x2FFFD }, { 0x30000, 0x3FFFD },
+};
+
+static bool in_ranges(uint32_t cp, const struct range* ranges, int count) {
+    int lo = 0;
+    int hi = count - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (cp < ranges[mid].first) hi = mid - 1;
+        else if (cp > ranges[mid].last) lo = mid + 1;
+        else return true;
+    }
+    return false;
+}
+
+int utf8_width(uint32_t cp) {
+    if (cp < 0x300) return 1;
+    if (in_ranges(cp, g_zero_width, sizeof(g_zero_width) / sizeof(g_zero_width[0]))) return 0;
+    if (in_ranges(cp, g_wide, sizeof(g_wide) / sizeof(g_wide[0]))) return 2;
+    return 1;
+}
+
+bool utf8_continuation(char c) {
+    return ((unsigned char) c & 0xC0) == 0x80;
+}
+
+int utf8_decode(const char* text, int len, uint32_t* cp) {
+    if (len <= 0) return 0;
+
+    unsigned char c = text[0];
+    if (c < 0x80) {
+        *cp = c;
+        return 1;
+    }
+
+    int n;
+    uint32_t min;
+    if ((c & 0xE0) == 0xC0) {
+        n = 2;
+        min = 0x80;
+        *cp = c & 0x1F;
+    } else if ((c & 0xF0) == 0xE0) {
+        n = 3;
+        min = 0x800;
+        *cp = c & 0x0F;
+    } else if ((c & 0xF8) == 0xF0) {
+        n = 4;
+        min = 0x10000;
+        *cp = c & 0x07;
+    } else {
+        *cp = UTF8_INVALID;
+        return 1;
+    }
+
+    if (n > len) {
+        *cp = UTF8_INVALID;
+        return 1;
+    }
+
+    for (int i = 1; i < n; i++) {
+        if (!utf8_continuation(text[i])) {
+            *cp = UTF8_INVALID;
+            return 1;
+        }
+        *cp = (*cp << 6) | (text[i] & 0x3F);
+    }
+
+    // overlong, a surrogate or past the end of unicode
+    if (*cp < min || (*cp >= 0xD800 && *cp <= 0xDFFF) || *cp > 0x10FFFF) {
+        *cp = UTF8_INVALID;
+        return 1;
+    }
+
+    return n;
+}
+
+int utf8_encode(uint32_t cp, char* out) {
+    if (cp < 0x80) {
+        out[0] = (char) cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char) (0xC0 | (cp >> 6));
+        out[1] = (char) (0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char) (0xE0 | (cp >> 12));
+        out[1] = (char) (0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char) (0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char) (0xF0 | (cp >> 18));
+    out[1] = (char) (0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char) (0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char) (0x80 | (cp & 0x3F));
+    return 4;
+}
+
+// the char at byte i of a + b. one can straddle the gap, those few bytes get copied together
+static int decode_at(const char* a, int a_len, const char* b, int b_len, int i, uint32_t* cp) {
+    if (i >= a_len) return utf8_decode(b + (i - a_len), b_len - (i - a_len), cp);
+    if (a_len - i >= 4 || b_len == 0) return utf8_decode(a + i, a_len - i, cp);
+
+    char joined[4];
+    int n = a_len - i;
+    memcpy(joined, a + i, n);
+    int extra = b_len < 4 - n ? b_len : 4 - n;
+    memcpy(joined + n, b, extra);
+    return utf8_decode(joined, n + extra, cp);
+}
+
+static int char_columns(uint32_t cp, int vcol) {
+    if (cp == '\t') return UTF8_TAB_WIDTH - vcol % UTF8_TAB_WIDTH;
+    if (cp < 0x20 || cp == 0x7F) return 2; // ^X
+    return utf8_width(cp);
+}
+
+static int layout(const char* a, int a_len, const char* b, int b_len, int wrap, int from,
+                  int* starts, int* vcols, int* width) {
+    int len = a_len + b_len;
+    int i = from;
+    int vcol = from; // everything before from is plain
+    int count = 0;
+
+    while (i < len) {
+        uint32_t cp;
+        int n = decode_at(a, a_len, b, b_len, i, &cp);
+        int w = char_columns(cp, vcol);
+
+        if (w == 2 && cp != '\t' && wrap > 1 && vcol % wrap == wrap - 1) vcol++; // onto the next row
+
+        if (starts != NULL) starts[count] = i;
+        if (vcols != NULL) vcols[count] = vcol;
+        count++;
+
+        vcol += w;
+        i += n;
+    }
+
+    if (starts != NULL) starts[count] = len;
+    if (vcols != NULL) vcols[count] = vcol;
+    *width = vcol;
+    return count;
+}
+
+int utf8_layout(const char* a, int a_len, const char* b, int b_len, int wrap, int* starts, int* vcols, int* width) {
+    return layout(a, a_len, b, b_len, wrap, 0, starts, vcols, width);
+}
+
+int utf8_line_width(const char* a, int a_len, const char* b, int b_len, int wrap) {
+    int plain = a_len > 0 ? (int) scan_plain(a, a_len) : 0;
+    if (plain == a_len && b_len > 0) plain += (int) scan_plain(b, b_len);
+    if (plain == a_len + b_len) return plain;
+
+    int width;
+    layout(a, a_len, b, b_len, wrap, plain, NULL, NULL, &width);
+    return width;
+}
@@ -0,0 +1,48 @@
+// Copyright 2025 JesusTouchMe
+
+#include "workers.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+struct worker {
+    void (*job)(void* ctx, int part);
+    void* ctx;
+    int part;
+    pthread_t thread;
+    bool running;
+};
+
+static void* worker_main(void* arg) {
+    struct worker* w = arg;
+    w->job(w->ctx, w->part);
+    return NULL;
+}
+
+int workers_for(size_t size, size_t min_part) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores > WORKERS_MAX) cores = WORKERS_MAX;
+
+    size_t parts = min_part > 0 ? size / min_part : 1;
+    if (cores > 0 && parts > (size_t) cores) parts = cores;
+    return parts > 1 ? (int) parts : 1;
+}
+
+void workers_run(int parts, void (*job)(void* ctx, int part), void* ctx) {
+    int threads = parts < WORKERS_MAX ? parts : WORKERS_MAX;
+
+    struct worker workers[WORKERS_MAX];
+    for (int i = 1; i < threads; i++) {
+        workers[i] = (struct worker) { .job = job, .ctx = ctx, .part = i };
+        workers[i].running = pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) == 0;
+    }
+
+    if (parts > 0) job(ctx, 0);
+    for (int i = threads; i < parts; i++) job(ctx, i);
+
+    for (int i = 1; i < threads; i++) {
+        if (workers[i].running) pthread_join(workers[i].thread, NULL);
+        else job(ctx, i);
+    }
+}